@@ -18,6 +18,19 @@
 #include "ar_perfs.h"
 #include "utils.h"
 #include "model.h"
+#include "ar_pmu.h"
+#include "ar_netlink.h"
+#include "ar_uapi.h"
+#include "ar_policy.h"
+#include "ar_probe.h"
+#include <trace/events/power.h>
+#if defined(CONFIG_AR_TASK_WORK)
+#include <linux/task_work.h>
+#include <linux/sched/task.h>
+#endif
+
+#define CREATE_TRACE_POINTS
+#include "ar_trace.h"
 
 /**************************************************************************
  * Public Definitions
@@ -27,17 +40,6 @@
 
 
 
-/**************************************************************************
- * COUNTERS Format (Umask_code - EventCode) tools/perf/pmu-events/arch/x86/)
- **************************************************************************/
-#if defined(__aarch64__) || defined(__arm__)
-#  define PMU_LLC_MISS_COUNTER_ID 0x17   // LINE_REFILL
-#  define PMU_LLC_WB_COUNTER_ID   0x18   // LINE_WB
-#elif defined(__x86_64__) || defined(__i386__)
-#  define PMU_LLC_MISS_COUNTER_ID 0x08b0 // OFFCORE_REQUESTS.ALL_DATA_RD
-#  define PMU_LLC_WB_COUNTER_ID   0x40b0 // OFFCORE_REQUESTS.WB
-#  define PMU_STALL_L3_MISS_CYCLES_COUNTER_ID   0x06A3 //CYCLE_ACTIVITY.STALLS_L3_MISS, 
-#endif
 
 /**************************************************************************
  * Local Function Declarations
@@ -47,6 +49,7 @@ static void deinitialize_cpu_info(const u8 cpu_id);
 static int  setup_cpu_info(const u8 cpu_id);
 static void ar_handle_read_overflow(struct irq_work *entry);
 static enum hrtimer_restart new_ar_regu_timer_callback(struct hrtimer *timer);
+AR_VISIBLE_IF_KUNIT u8 ar_core_new_interval(struct core_info *cinfo);
 
 /**************************************************************************
  * External Function Declarations
@@ -61,12 +64,15 @@ module_param(g_read_counter_id, hexint,  S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 
 u64 g_bw_intial_setpoint_mb[MAX_NO_CPUS+1] = {0,1000,1000,1000,1000}; /*Pre-defined initial / min Bandwidth in MB/s */
 u64 g_bw_max_mb[MAX_NO_CPUS+1] = {0,30000,30000,30000,30000}; /*Pre-defined max Bandwidth per core in MB/s */
+/* Load time setpoints, one per CPU starting with CPU0 (unused), e.g. setpoint_mb=0,900,900,900,900 */
+module_param_array_named(setpoint_mb, g_bw_intial_setpoint_mb, ullong, NULL, S_IRUSR | S_IRGRP);
 
 /**************************************************************************
  * Public Types
  **** **********************************************************************/
 
 static struct core_info all_cinfo[MAX_NO_CPUS + 1];
+static bool ar_idle_probe_registered;
 
 struct core_info* get_core_info(u8 cpu_id){
     switch(cpu_id){
@@ -110,6 +116,7 @@ static void __start_timer_on_cpu(void* cpu)
 
 static enum hrtimer_restart new_ar_regu_timer_callback(struct hrtimer *timer)
 {
+    u64 t_start = local_clock();
     u8 cpu_id = smp_processor_id();
     AR_DEBUG("\n");
 
@@ -122,18 +129,26 @@ static enum hrtimer_restart new_ar_regu_timer_callback(struct hrtimer *timer)
     */
     cinfo->read_event->pmu->stop(cinfo->read_event, PERF_EF_UPDATE);
 
-    u64 read_event_new_budget = atomic64_read(&cinfo->budget_est);
-    local64_set(&cinfo->read_event->hw.period_left, read_event_new_budget);
-    AR_DEBUG("CPU(%u):New budget: %llu\n",cpu_id,read_event_new_budget);
+    /* Idle core: keep the counter stopped and the timer off until it wakes up */
+    if (is_idle_task(current) && ar_idle_park()) {
+        atomic_set(&cinfo->throttler_task,false);
+        cinfo->overflowed = false;
+        cinfo->lat.t_overflow = 0;
+        WRITE_ONCE(cinfo->parked, true);
+        trace_areg_idle(cpu_id, true);
+        ar_overhead_add(cinfo, AR_OVH_TIMER, local_clock() - t_start);
+        return HRTIMER_NORESTART;
+    }
 
-    //un-throttle if the core is in throttle state
-    atomic_set(&cinfo->throttler_task,false);
+    u8 shift = ar_core_new_interval(cinfo);
 
-    hrtimer_forward_now(timer, ms_to_ktime(get_regulation_time()));
+    hrtimer_forward_now(timer, ms_to_ktime(get_regulation_time() << shift));
 
     /*Re-enabled the counter*/
     cinfo->read_event->pmu->start(cinfo->read_event, PERF_EF_RELOAD);
 
+    ar_overhead_add(cinfo, AR_OVH_TIMER, local_clock() - t_start);
+
     /*Re-enabled the timer*/
     return HRTIMER_RESTART;
 }
@@ -159,6 +174,13 @@ static int throttler_task_func1(void * data){
             break;
 
         AR_DEBUG("CPU(%d):Throttling...\n",cpu_id);
+        trace_areg_throttle_start(cpu_id);
+        u64 throttle_start = local_clock();
+        ar_latency_record_spin(cinfo, throttle_start,
+                               perf_event_read_now(cinfo->read_event));
+        if (cinfo->lat.t_wakeup)
+            ar_overhead_add(cinfo, AR_OVH_THROTTLER,
+                            throttle_start - cinfo->lat.t_wakeup);
        while (atomic_read(&cinfo->throttler_task)
                  && !kthread_should_stop())
        {
@@ -166,12 +188,215 @@ static int throttler_task_func1(void * data){
            cpu_relax();
            /* TODO: mwait */
        }
+        u64 throttled_ns = local_clock() - throttle_start;
+        atomic64_add(throttled_ns, &cinfo->pmu_count[AR_PMU_THROTTLED_NS]);
+        trace_areg_throttle_end(cpu_id, throttled_ns);
     }
 
     pr_info("%s: Exit",__func__);
     return 0;
 }
 
+/**************************************************************************
+ * task_work enforcement (CONFIG_AR_TASK_WORK)
+ *
+ * Instead of waking the throttler kthread, the overflow queues a task_work
+ * on the user task it interrupted. The task then sleeps in its own
+ * return-to-user path until the core's timer starts the next interval;
+ * kernel threads and interrupts on the core keep running. A throttled task
+ * costs one sleep/wakeup instead of two kthread context switches.
+ **************************************************************************/
+#if defined(CONFIG_AR_TASK_WORK)
+
+static void ar_throttle_twork_func(struct callback_head *head)
+{
+    struct core_info *cinfo = container_of(head, struct core_info, throttle_twork);
+    struct task_struct *p = xchg(&cinfo->twork_task, NULL);
+    u8 cpu_id = cinfo->cpu_id;
+
+    /* Dequeued: ar_task_work_drain() can no longer cancel it */
+    if (p)
+        put_task_struct(p);
+
+    /* The head may be queued again from here on */
+    atomic_set(&cinfo->twork_queued, false);
+
+    /* Run from exit_task_work(): let the task die */
+    if (current->flags & PF_EXITING)
+        goto out;
+
+    trace_areg_throttle_start(cpu_id);
+    u64 throttle_start = local_clock();
+
+    /* Latency and skid are only meaningful if the task did not migrate */
+    if (get_cpu() == cpu_id)
+        ar_latency_record_spin(cinfo, throttle_start,
+                               perf_event_read_now(cinfo->read_event));
+    put_cpu();
+
+    wait_event_interruptible(cinfo->release_evt,
+                             !atomic_read(&cinfo->throttler_task));
+
+    u64 throttled_ns = local_clock() - throttle_start;
+    atomic64_add(throttled_ns, &cinfo->pmu_count[AR_PMU_THROTTLED_NS]);
+    trace_areg_throttle_end(cpu_id, throttled_ns);
+out:
+    atomic_dec(&cinfo->twork_inflight);
+}
+
+/* irq_work context: throttle the interrupted user task, false if there is none */
+static bool ar_throttle_current(struct core_info *cinfo)
+{
+    struct task_struct *p = current;
+
+    if (!ar_task_work_throttle() || !p->mm || (p->flags & (PF_KTHREAD | PF_EXITING)))
+        return false;
+
+    if (atomic_xchg(&cinfo->twork_queued, true))
+        return true;
+
+    atomic_inc(&cinfo->twork_inflight);
+    WRITE_ONCE(cinfo->twork_task, get_task_struct(p));
+    if (task_work_add(p, &cinfo->throttle_twork, TWA_RESUME)) {
+        put_task_struct(xchg(&cinfo->twork_task, NULL));
+        atomic_dec(&cinfo->twork_inflight);
+        atomic_set(&cinfo->twork_queued, false);
+        return false;
+    }
+    return true;
+}
+
+static bool ar_task_work_cancel(struct task_struct *p, struct core_info *cinfo)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 11, 0)
+    return task_work_cancel(p, &cinfo->throttle_twork);
+#else
+    return task_work_cancel(p, ar_throttle_twork_func) != NULL;
+#endif
+}
+
+static void ar_release_throttled(struct core_info *cinfo)
+{
+    if (waitqueue_active(&cinfo->release_evt))
+        wake_up_interruptible(&cinfo->release_evt);
+}
+
+static void ar_task_work_init(struct core_info *cinfo)
+{
+    init_task_work(&cinfo->throttle_twork, ar_throttle_twork_func);
+    cinfo->twork_task = NULL;
+    atomic_set(&cinfo->twork_queued, false);
+    atomic_set(&cinfo->twork_inflight, 0);
+    init_waitqueue_head(&cinfo->release_evt);
+}
+
+/*
+ * Wait until no task can still run ar_throttle_twork_func() for @cinfo.
+ * A work still queued only runs when its task returns to user space, which
+ * a task blocked in the kernel may not do for a long time: cancel it. The
+ * works left are sleeping on release_evt and return once woken.
+ */
+static void ar_task_work_drain(struct core_info *cinfo)
+{
+    struct task_struct *p = xchg(&cinfo->twork_task, NULL);
+
+    if (p) {
+        if (ar_task_work_cancel(p, cinfo)) {
+            atomic_set(&cinfo->twork_queued, false);
+            atomic_dec(&cinfo->twork_inflight);
+        }
+        put_task_struct(p);
+    }
+
+    atomic_set(&cinfo->throttler_task, false);
+    ar_release_throttled(cinfo);
+    while (atomic_read(&cinfo->twork_inflight))
+        msleep(1);
+}
+
+#else
+
+static inline bool ar_throttle_current(struct core_info *cinfo) { return false; }
+static inline void ar_release_throttled(struct core_info *cinfo) { }
+static inline void ar_task_work_init(struct core_info *cinfo) { }
+static inline void ar_task_work_drain(struct core_info *cinfo) { }
+
+#endif /* CONFIG_AR_TASK_WORK */
+
+/**************************************************************************
+ * Core state machine
+ *
+ * running --overflow--> throttled --new interval--> running
+ *
+ * Both transitions take the core explicitly instead of smp_processor_id(),
+ * so ar_kunit.c can drive them with a fake counter.
+ **************************************************************************/
+
+/*
+ * Budget exhausted (overflow irq_work): account it and throttle the core,
+ * unless in monitor-only mode. Returns true if the core was throttled.
+ */
+AR_VISIBLE_IF_KUNIT bool ar_core_overflow(struct core_info *cinfo)
+{
+    trace_areg_overflow(cinfo->cpu_id, perf_event_count(cinfo->read_event));
+    atomic64_inc(&cinfo->pmu_count[AR_PMU_OVERFLOWS]);
+    /* Snap back: start the next, shortest interval one regulation time from now */
+    if (ar_adapt_overflow(&cinfo->adapt) && regulation_enabled())
+        hrtimer_start(&cinfo->reg_timer, ms_to_ktime(get_regulation_time()),
+                      HRTIMER_MODE_REL_PINNED);
+    cinfo->overflowed = true;
+
+    if (ar_monitor_only()) {
+        cinfo->lat.t_overflow = 0;
+        return false;
+    }
+
+    //Activate Throttling
+    atomic_set(&cinfo->throttler_task,true);
+    if (!ar_throttle_current(cinfo))
+        wake_up_interruptible(&cinfo->throttle_evt);
+    cinfo->lat.t_wakeup = local_clock();
+    return true;
+}
+
+/*
+ * Start a new interval on the stopped counter (regulation timer): refill
+ * and re-arm the budget, score the interval that ended and unthrottle.
+ * Returns the adaptive shift of the new interval.
+ */
+AR_VISIBLE_IF_KUNIT u8 ar_core_new_interval(struct core_info *cinfo)
+{
+    /* budget_est is per regulation time; scale it to the core's interval */
+    u8 shift = READ_ONCE(cinfo->adapt.shift);
+    u64 count_now = perf_event_count(cinfo->read_event);
+    u64 read_event_new_budget = ar_bucket_refill(&cinfo->bucket,
+                                    atomic64_read(&cinfo->budget_est) << shift,
+                                    count_now);
+    local64_set(&cinfo->read_event->hw.period_left,
+                ar_skid_arm(cinfo, read_event_new_budget, count_now));
+    AR_DEBUG("CPU(%u):New budget: %llu\n",cinfo->cpu_id,read_event_new_budget);
+    trace_areg_budget_update(cinfo->cpu_id, read_event_new_budget);
+
+    /* Budget exhausted in the interval that just ended = under-provisioned */
+    if (cinfo->overflowed)
+        cinfo->acc.nr_under++;
+    else
+        cinfo->acc.nr_over++;
+    cinfo->overflowed = false;
+
+    atomic64_add(READ_ONCE(cinfo->budget_mb) << shift,
+                 &cinfo->pmu_count[AR_PMU_BUDGET_MB]);
+    atomic64_add(max_t(s64, READ_ONCE(cinfo->next_estimate), 0) << shift,
+                 &cinfo->pmu_count[AR_PMU_PREDICTED_MB]);
+    atomic64_inc(&cinfo->pmu_count[AR_PMU_INTERVALS]);
+
+    //un-throttle if the core is in throttle state
+    atomic_set(&cinfo->throttler_task,false);
+    ar_release_throttled(cinfo);
+    cinfo->lat.t_overflow = 0;
+    return shift;
+}
+
 /* Callback when read counter exhuasts its budget*/
 static void read_event_overflow_callback(struct perf_event *event,
                     struct perf_sample_data *data,
@@ -185,6 +410,12 @@ static void read_event_overflow_callback(struct perf_event *event,
 
     struct core_info *cinfo = get_core_info(cpu_id);
     BUG_ON(!cinfo);
+
+    /* Keep the stamps of the first overflow until the throttler consumes them */
+    if (cinfo->lat.t_overflow == 0) {
+        cinfo->lat.t_overflow = local_clock();
+        cinfo->lat.count_at_overflow = perf_event_count(event);
+    }
     irq_work_queue(&cinfo->read_irq_work);
 }
 
@@ -201,11 +432,43 @@ static void ar_handle_read_overflow(struct irq_work *entry)
 
     struct core_info *cinfo = get_core_info(cpu_id);
     BUG_ON(!cinfo);
+    cinfo->lat.t_irq_work = local_clock();
+    ar_core_overflow(cinfo);
+}
 
-    //Activate Throttling
-    atomic_set(&cinfo->throttler_task,true);
-    wake_up_interruptible(&cinfo->throttle_evt);
+/* First idle exit of a parked core: start a fresh interval (irq_work context) */
+static void ar_handle_idle_exit(struct irq_work *entry)
+{
+    struct core_info *cinfo = container_of(entry, struct core_info, idle_irq_work);
+
+    if (!READ_ONCE(cinfo->parked) || !regulation_enabled())
+        return;
+
+    WRITE_ONCE(cinfo->parked, false);
+    trace_areg_idle(cinfo->cpu_id, false);
+
+    u8 shift = READ_ONCE(cinfo->adapt.shift);
+    u64 count_now = perf_event_count(cinfo->read_event);
+    u64 tokens = ar_bucket_refill(&cinfo->bucket,
+                                  atomic64_read(&cinfo->budget_est) << shift,
+                                  count_now);
+    local64_set(&cinfo->read_event->hw.period_left,
+                ar_skid_arm(cinfo, tokens, count_now));
+    cinfo->read_event->pmu->start(cinfo->read_event, PERF_EF_RELOAD);
+
+    hrtimer_start(&cinfo->reg_timer, ms_to_ktime(get_regulation_time() << shift),
+                  HRTIMER_MODE_REL_PINNED);
+}
 
+/* cpu_idle tracepoint probe; runs in the idle loop with interrupts disabled */
+static void ar_cpu_idle_probe(void *data, unsigned int state, unsigned int cpu_id)
+{
+    if (state != PWR_EVENT_EXIT || cpu_id < 1 || cpu_id > MAX_NO_CPUS)
+        return;
+
+    struct core_info *cinfo = get_core_info(cpu_id);
+    if (READ_ONCE(cinfo->parked))
+        irq_work_queue(&cinfo->idle_irq_work);
 }
 
 
@@ -232,13 +495,17 @@ static int  setup_cpu_info(const u8 cpu_id){
 
     /* Initialize NMI irq_work_queue */
     init_irq_work(&cinfo->read_irq_work, ar_handle_read_overflow);
+    init_irq_work(&cinfo->idle_irq_work, ar_handle_idle_exit);
 
     /* Disable the throttle flag */
     atomic_set(&cinfo->throttler_task,false);   
+    ar_task_work_init(cinfo);
     
 
     /* Initialize Wait queue for throttler */
     init_waitqueue_head(&cinfo->throttle_evt);
+    spin_lock_init(&cinfo->lat.lock);
+    spin_lock_init(&cinfo->acc.lock);
 
     /* TODO: Investigate kthread_run_on_cpu API which is  a convenience wrapper
      * for kthread_creat_on_node + kthread_bind + wake_up_process.
@@ -269,7 +536,7 @@ static int  setup_cpu_info(const u8 cpu_id){
     cinfo->reg_timer.function = &new_ar_regu_timer_callback;
 
     /***** Regulation to be started by setting
-    /sys/kernel/debug/ar/enable_regulation to 1 ****/
+    /sys/kernel/debug/ar/enable_regulation to 1 or AREG_CMD_SET ****/
 
     /* Initiialize weight matrix to predefined values */
     initialize_weight_matrix(cinfo, true);
@@ -294,6 +561,9 @@ static void deinitialize_cpu_info( const u8 cpu_id){
     // WARNING: Ensure timer is intialized before cancelling
     
     hrtimer_cancel(&cinfo->reg_timer);
+    irq_work_sync(&cinfo->idle_irq_work);
+    irq_work_sync(&cinfo->read_irq_work);
+    ar_task_work_drain(cinfo);
     
     //End the throttle thread
     if(cinfo->throttler_thread){
@@ -316,25 +586,48 @@ void start_regulation(u8 cpu_id){
     cinfo->next_estimate=0;
     cinfo->prev_estimate=0;
 
+    ar_overhead_reset(cinfo);
+    ar_skid_reset(cinfo);
+    ar_bucket_reset(&cinfo->bucket);
+    ar_shadow_reset(cinfo);
+    cinfo->overflowed = false;
+    ar_adapt_reset(&cinfo->adapt);
+    WRITE_ONCE(cinfo->parked, false);
+
     /* Enable perf event */
     enable_event(cinfo->read_event);
 
     /* Start the timer on the specific core*/
     smp_call_function_single(cpu_id,__start_timer_on_cpu,(void*)(long)cpu_id,false);
-    pr_info("%s: Exit: (CPU %u)",__func__,cpu_id );
+    pr_debug("%s: Exit: (CPU %u)",__func__,cpu_id );
 }
 
 void stop_regulation(u8 cpu_id){
     struct core_info* cinfo = get_core_info(cpu_id);
     BUG_ON(cinfo==NULL);
 
+    /*
+     * regulation_enabled() is already false, so a resume queued from now on
+     * is a no-op; one already past the check restarts the counter and the
+     * timer, so wait for it before stopping both.
+     */
+    irq_work_sync(&cinfo->idle_irq_work);
+    WRITE_ONCE(cinfo->parked, false);
+
     /* Disable perf event */
-    perf_event_disable(cinfo->read_event);
+    pause_event(cinfo->read_event);
+
+    /* An overflow being handled may bring the timer forward: wait for it */
+    irq_work_sync(&cinfo->read_irq_work);
 
     /* Stop the timer running on the specific core. Even if the timer
      is pinned to a core , it can be cancelled from any other core*/
     hrtimer_cancel(&cinfo->reg_timer);
-    pr_info("%s: Exit: (CPU %u)",__func__,cpu_id );
+
+    /* Release tasks still throttled through task_work */
+    atomic_set(&cinfo->throttler_task,false);
+    ar_release_throttled(cinfo);
+    pr_debug("%s: Exit: (CPU %u)",__func__,cpu_id );
 }
 /**************************************************************************************************************************
  * Module main
@@ -342,9 +635,22 @@ void stop_regulation(u8 cpu_id){
 
 static int __init ar_init (void ){
 
+    /* areg_kunit.ko only carries the code for ar_kunit.c; nothing is started */
+    if (IS_ENABLED(CONFIG_AR_KUNIT))
+        return 0;
+
     pr_info("Supported CPUs: %d, online_cpus: %d\n", NR_CPUS, num_online_cpus());
 //    pr_info("FPU supported : %d",kernel_fpu_available());
 
+    /* Setpoints beyond AREG_BW_MAX_MB overflow the event conversion */
+    u8 cpu_id;
+    for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++) {
+        if (g_bw_intial_setpoint_mb[cpu_id] > AREG_BW_MAX_MB) {
+            pr_err("setpoint_mb[%u] above %llu MB/s", cpu_id, AREG_BW_MAX_MB);
+            return -EINVAL;
+        }
+    }
+
     //Initialise core infos
     memset(all_cinfo, 0, sizeof(all_cinfo));
 
@@ -383,12 +689,25 @@ static int __init ar_init (void ){
         return -ENOMEM;
     }
 
+    /* Resume parked cores on idle exit */
+    ret = register_trace_cpu_idle(ar_cpu_idle_probe, NULL);
+    if (ret)
+        pr_warn("%s: cpu_idle probe not registered (%d), idle park disabled",
+                __func__, ret);
+    ar_idle_probe_registered = !ret;
+
     /* Initialize the master thread */
     initialize_master();
 
     /* Create entries in debugfs */
     ar_init_debugfs();
 
+    /* Expose the regulator counters to perf. Regulation works without it */
+    ar_pmu_init();
+
+    /* Generic netlink control channel. debugfs knobs remain available */
+    ar_nl_init();
+
     pr_info("Module Initialized\n");
     return 0;
 
@@ -397,10 +716,25 @@ static int __init ar_init (void ){
 
 static void __exit ar_exit( void )
 {
-    /* Keep the deinitializing sequence reverse of the allocation sequence seen in  __init function */
-    ar_remove_debugfs();
-    
+    if (IS_ENABLED(CONFIG_AR_KUNIT))
+        return;
+
+    /* Keep the deinitializing sequence reverse of the allocation sequence seen in  __init function,
+     * except for the master: it sends the netlink events, so it goes first */
     deinitialize_master();
+
+    ar_nl_exit();
+
+    ar_pmu_exit();
+
+    ar_remove_debugfs();
+
+    ar_probe_exit();
+
+    if (ar_idle_probe_registered) {
+        unregister_trace_cpu_idle(ar_cpu_idle_probe, NULL);
+        tracepoint_synchronize_unregister();
+    }
     
     deinitialize_cpu_info((u8)1);
     
@@ -410,6 +744,8 @@ static void __exit ar_exit( void )
     
     deinitialize_cpu_info((u8)4);
 
+    ar_perfs_exit();
+
     pr_info("Module removed\n");
 	return;
 }
@@ -1,9 +1,25 @@
 #if !defined AR_H
 #define AR_H
 
+#include "ar_stats.h"
+#include "ar_pmu.h"
+#include "ar_policy.h"
+
+/* Override with make AR_HIST_SIZE=N */
+#if !defined(HIST_SIZE)
 #define HIST_SIZE 5
+#endif
 #define MAX_NO_CPUS 4
 
+/* Static in areg.ko, visible to the suites of areg_kunit.ko (make kunit) */
+#if defined(CONFIG_AR_KUNIT)
+#define AR_VISIBLE_IF_KUNIT
+#else
+#define AR_VISIBLE_IF_KUNIT static
+#endif
+
+#include "ar_shadow.h"
+
 /* Each CPU core's info */
 struct core_info {
   u64 g_read_count_new;
@@ -43,6 +59,53 @@ struct core_info {
   
   s64 next_estimate;
   s64 prev_estimate;
+
+  // Predictor used for next_estimate (enum areg_predictor)
+  u8 predictor;
+
+  // Budget in MB/s matching budget_est
+  u64 budget_mb;
+
+  // Counters exported through the areg PMU (enum ar_pmu_event). Atomic:
+  // the task_work throttle adds its time from whatever CPU the task is on
+  atomic64_t pmu_count[AR_PMU_NR_EVENTS];
+
+  // Overflow to throttle latency histograms
+  struct ar_latency lat;
+
+  // Time and invocations spent in the regulator on behalf of this core
+  struct ar_overhead ovh;
+
+  // Online prediction accuracy and provisioning counts
+  struct ar_accuracy acc;
+
+  // Timer and counter suspended while the core is idle, see ar_cpu_idle_probe()
+  bool parked;
+  struct irq_work idle_irq_work;
+
+#if defined(CONFIG_AR_TASK_WORK)
+  // Throttle in the context of the offending task, see ar_throttle_current()
+  struct callback_head throttle_twork;
+  struct task_struct *twork_task;   // holds a reference while queued
+  atomic_t twork_queued;
+  atomic_t twork_inflight;
+  wait_queue_head_t release_evt;
+#endif
+
+  // Tokens carried over between intervals
+  struct ar_bucket bucket;
+
+  // Overshoot past the armed period and its compensation
+  struct ar_skid skid;
+
+  // Budget exhausted in the current interval (set even in monitor-only mode)
+  bool overflowed;
+
+  // Second predictor/policy scored on the same inputs, never enforced
+  struct ar_shadow shadow;
+
+  // Adaptive regulation interval (budget_est is per regulation time)
+  struct ar_adapt adapt;
   
 };
 
@@ -50,6 +113,11 @@ struct core_info *get_core_info(u8 cpu_id);
 void start_regulation(u8 cpu_id);
 void stop_regulation(u8 cpu_id);
 
+#if defined(CONFIG_AR_KUNIT)
+bool ar_core_overflow(struct core_info *cinfo);
+u8 ar_core_new_interval(struct core_info *cinfo);
+#endif
+
 
 struct bw_distribution {
   u32 time;
@@ -0,0 +1,130 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * Budget arithmetic: token bucket refill, max-min fair distribution and
+ * the contention gate hysteresis. No module state and no tunables are
+ * touched here, the callers pass them in, so the same code also builds
+ * into the userspace simulator (tools/areg-sim).
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+
+/**************************************************************************
+ * Included Files
+ **************************************************************************/
+#include "kernel_headers.h"
+#include "ar_budget.h"
+
+/**************************************************************************
+ * Token bucket
+ **************************************************************************/
+
+void ar_bucket_reset(struct ar_bucket *b)
+{
+    b->level = 0;
+    b->refill = 0;
+    b->count_at_start = 0;
+}
+
+/*
+ * A new interval starts with @refill events of budget and the counter at
+ * @count_now. Unused tokens carry over up to @depth_pct of @refill; a
+ * depth of 100 or less means no carry over. Returns the tokens available
+ * for the interval.
+ */
+u64 ar_bucket_fill(struct ar_bucket *b, u64 refill, u64 count_now, u32 depth_pct)
+{
+    u64 consumed = count_now - b->count_at_start;
+    u64 left = (b->level > consumed) ? b->level - consumed : 0;
+    u64 depth = max_t(u64, div_u64(refill * depth_pct, 100), refill);
+
+    b->count_at_start = count_now;
+    b->refill = refill;
+    b->level = min_t(u64, left + refill, depth);
+    return b->level;
+}
+
+/**************************************************************************
+ * Distribution
+ **************************************************************************/
+
+/* Max-min fair share of *@avail, raising got[i] towards cap[i] */
+void ar_fair_fill(u64 *got, const u64 *cap, int n, u64 *avail)
+{
+    for (;;) {
+        int hungry = 0;
+        int i;
+
+        for (i = 0; i < n; i++)
+            if (got[i] < cap[i])
+                hungry++;
+        if (!hungry || *avail == 0)
+            return;
+
+        u64 share = max_t(u64, div_u64(*avail, hungry), 1);
+        for (i = 0; i < n && *avail; i++) {
+            if (got[i] >= cap[i])
+                continue;
+            u64 give = min3(share, cap[i] - got[i], *avail);
+            got[i] += give;
+            *avail -= give;
+        }
+    }
+}
+
+/**************************************************************************
+ * Contention gate
+ **************************************************************************/
+
+bool ar_gate_enabled(const struct ar_gate_marks *m)
+{
+    return m->high_mb || m->high_lat_ns;
+}
+
+/* A mark of 0 is disabled: never above high, always below low */
+static bool ar_gate_above(u64 v, u64 high)
+{
+    return high && v >= high;
+}
+
+/* An unset low mark is AR_GATE_LOW_DEFAULT_PCT of high, not 0 */
+static bool ar_gate_below_low(u64 v, u64 high, u64 low)
+{
+    if (!high)
+        return true;
+    if (!low)
+        low = div_u64(high * AR_GATE_LOW_DEFAULT_PCT, 100);
+    return v < min(low, high);
+}
+
+/*
+ * One iteration with the summed consumption @total_mb and the loaded
+ * latency @lat_ns. Returns true while budgets are to be enforced.
+ */
+bool ar_gate_step(struct ar_gate *gate, const struct ar_gate_marks *m,
+                  u64 total_mb, u64 lat_ns)
+{
+    bool regulating = gate->regulating;
+
+    if (!ar_gate_enabled(m)) {
+        regulating = true;
+    } else if (!regulating) {
+        regulating = ar_gate_above(total_mb, m->high_mb) ||
+                     ar_gate_above(lat_ns, m->high_lat_ns);
+        gate->below = 0;
+    } else if (ar_gate_below_low(total_mb, m->high_mb, m->low_mb) &&
+               ar_gate_below_low(lat_ns, m->high_lat_ns, m->low_lat_ns)) {
+        /* Budgets hold consumption down; require it to stay low */
+        regulating = ++gate->below < m->hold;
+    } else {
+        gate->below = 0;
+    }
+
+    if (regulating != gate->regulating) {
+        gate->regulating = regulating;
+        gate->transitions++;
+    }
+    return regulating;
+}
@@ -0,0 +1,52 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#if !defined AR_BUDGET_H
+#define AR_BUDGET_H
+
+/*
+ * Per-core token bucket (events). Refilled by the budget every interval,
+ * capped at the bucket depth; the counter is armed with the bucket level.
+ * Timer and idle-exit path only, both on the core.
+ */
+struct ar_bucket {
+    u64 level;
+    u64 refill;
+    u64 count_at_start;
+};
+
+/* Low mark used when only the high mark of a pair is set */
+#define AR_GATE_LOW_DEFAULT_PCT 90
+
+/*
+ * Marks of the contention gate; a high mark of 0 disables that pair, a low
+ * mark of 0 stands for AR_GATE_LOW_DEFAULT_PCT of the high mark
+ */
+struct ar_gate_marks {
+    u64 high_mb;
+    u64 low_mb;
+    u64 high_lat_ns;
+    u64 low_lat_ns;
+    u32 hold;
+};
+
+/* Hysteresis state of the contention gate */
+struct ar_gate {
+    bool regulating;
+    u32 below;
+    u64 transitions;
+};
+
+void ar_bucket_reset(struct ar_bucket *b);
+u64 ar_bucket_fill(struct ar_bucket *b, u64 refill, u64 count_now, u32 depth_pct);
+void ar_fair_fill(u64 *got, const u64 *cap, int n, u64 *avail);
+bool ar_gate_enabled(const struct ar_gate_marks *m);
+bool ar_gate_step(struct ar_gate *gate, const struct ar_gate_marks *m,
+                  u64 total_mb, u64 lat_ns);
+
+#endif /* AR_BUDGET_H */
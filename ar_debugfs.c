@@ -13,29 +13,103 @@
 #include "kernel_headers.h"
 #include "ar.h"
 #include "ar_debugfs.h"
+#include "ar_stats.h"
+#include "ar_policy.h"
+#include "ar_group.h"
+#include "ar_probe.h"
+#include "ar_shadow.h"
+#include "ar_perfs.h"
+#include "ar_uapi.h"
 
 
-/**************************************************************************
- * Constants /Macros
- **************************************************************************/
-#define BUF_SIZE 256
-
 /**************************************************************************
  * Globals
  **************************************************************************/
 static u32 ar_regulation_time_ms = 1; //ms, default 1000ms
 static u32 ar_observation_time_ms = 1000;
-atomic_t enable_reg; // Memory regulation enabled or disabled via debugfs
+atomic_t enable_reg; // Memory regulation enabled or disabled via debugfs/netlink
 static struct dentry *ar_dir = NULL;
 
+/* Serializes configuration changes (debugfs, netlink) against the master */
+static DEFINE_MUTEX(ar_ctrl_mutex);
+
+/**************************************************************************
+ * Control interface shared by debugfs and netlink
+ **************************************************************************/
+
+void ar_ctrl_lock(void)
+{
+    mutex_lock(&ar_ctrl_mutex);
+}
+
+void ar_ctrl_unlock(void)
+{
+    mutex_unlock(&ar_ctrl_mutex);
+}
+
+/* Caller holds ar_ctrl_lock() */
+int set_regulation_time(u32 ms)
+{
+    if (ms == 0 || ms > AREG_REGU_INTERVAL_MAX_MS)
+        return -EINVAL;
+    WRITE_ONCE(ar_regulation_time_ms, ms);
+    return 0;
+}
+
+/* Caller holds ar_ctrl_lock() */
+int set_observation_time(u32 ms)
+{
+    if (ms == 0)
+        return -EINVAL;
+    WRITE_ONCE(ar_observation_time_ms, ms);
+    return 0;
+}
+
+u32 get_observation_time(void)
+{
+    return READ_ONCE(ar_observation_time_ms);
+}
+
+bool regulation_enabled(void)
+{
+    return atomic_read(&enable_reg);
+}
+
+/* Start or stop regulation on all regulated cores. Caller holds ar_ctrl_lock() */
+void set_regulation(bool enable)
+{
+    u8 cpu_id;
+
+    if (regulation_enabled() == enable)
+        return;
+
+    atomic_set(&enable_reg, enable);
+
+    for_each_online_cpu(cpu_id){
+        switch(cpu_id){
+            case 1:
+            case 2:
+            case 3:
+            case 4:
+                if (enable){
+                    start_regulation(cpu_id);
+                }else{
+                    stop_regulation(cpu_id);
+                }
+                break;
+            default: continue;
+        }
+    }
+
+    pr_info("Regulation %s",(enable?"Enabled":"Disabled"));
+}
+
 /****************************************
  * Fops functions for Regulation interval
  ****************************************/
 static int ar_reg_interval_show(struct seq_file *m, void *v)
 {
-    int tmp = ar_regulation_time_ms;
-    pr_info("%s: Reading.",__func__);
-    seq_printf(m, "%u\n",tmp);
+    seq_printf(m, "%u\n", get_regulation_time());
     return 0;
 }
 
@@ -48,23 +122,19 @@ static ssize_t ar_reg_interval_write(struct file *filp,
                     const char __user *ubuf,
                     size_t cnt, loff_t *ppos){
 
-    char buf[BUF_SIZE];
     u32 tmp = 0 ;
-
-    if (copy_from_user(&buf, ubuf, (cnt > BUF_SIZE) ? BUF_SIZE: cnt) != 0)
-        return 0;
-
-    pr_info("%s: Received %s",__func__,buf);
-
-    int ret = kstrtou32(buf, 10, &tmp);
+    int ret = kstrtou32_from_user(ubuf, cnt, 10, &tmp);
 
     if (ret){
         pr_err("%s: ret %d",__func__,ret);
         return ret;
     }
 
-    ar_regulation_time_ms =  tmp;
-    return cnt;
+    ar_ctrl_lock();
+    ret = set_regulation_time(tmp);
+    ar_ctrl_unlock();
+
+    return ret ? ret : cnt;
 }
 
 /****************************************
@@ -74,30 +144,24 @@ static ssize_t ar_obs_interval_write(struct file *filp,
                     const char __user *ubuf,
                     size_t cnt, loff_t *ppos){
 
-    char buf[BUF_SIZE];
     u32 tmp = 0 ;
-
-    if (copy_from_user(&buf, ubuf, (cnt > BUF_SIZE) ? BUF_SIZE: cnt) != 0)
-        return 0;
-
-    pr_info("%s: Received %s",__func__,buf);
-
-    int ret = kstrtou32(buf, 10, &tmp);
+    int ret = kstrtou32_from_user(ubuf, cnt, 10, &tmp);
 
     if (ret){
         pr_err("%s: ret %d",__func__,ret);
         return ret;
     }
 
-    ar_observation_time_ms =  tmp;
-    return cnt;
+    ar_ctrl_lock();
+    ret = set_observation_time(tmp);
+    ar_ctrl_unlock();
+
+    return ret ? ret : cnt;
 }
 
 static int ar_obs_interval_show(struct seq_file *m, void *v)
 {
-    int tmp = ar_observation_time_ms;
-    pr_info("%s: Reading.",__func__);
-    seq_printf(m, "%u \n",tmp);
+    seq_printf(m, "%u \n", get_observation_time());
     return 0;
 }
 
@@ -112,47 +176,18 @@ static int ar_obs_interval_open(struct inode *inode, struct file *filp)
 ******************************************************/
 static ssize_t ar_enable_reg_write(struct file *filp,
                                 const char __user *ubuf,size_t cnt, loff_t *ppos) {
-    char buf[BUF_SIZE];
-    memset(buf,sizeof(buf),0);
     u8 user_value = false ;
-
-    if (copy_from_user(&buf, ubuf, (cnt > BUF_SIZE) ? BUF_SIZE: cnt) != 0)
-    return 0;
-
-    pr_info("%s: Received %s",__func__,buf);
-
-    int ret = kstrtou8(buf, 10, &user_value);
+    int ret = kstrtou8_from_user(ubuf, cnt, 10, &user_value);
 
     if (ret || (user_value > 1) ){
         pr_err("%s: Failed to update: Wrong value %u (error:%d)",__func__,user_value,ret);
         return -EINVAL;
     }
 
-    if ( atomic_read(&enable_reg) == user_value ){
-        pr_info("Regulation %s",(user_value?"Enabled":"Disabled"));
-        return cnt;
-    }
-
-    atomic_set(&enable_reg,(user_value?true:false) );
+    ar_ctrl_lock();
+    set_regulation(user_value);
+    ar_ctrl_unlock();
 
-    u8 cpu_id;
-    for_each_online_cpu(cpu_id){
-        switch(cpu_id){
-            case 1:
-            case 2:
-            case 3:
-            case 4:
-                if (user_value){
-                    start_regulation(cpu_id);
-                }else{
-                    stop_regulation(cpu_id);
-                }
-                break;
-            default: continue;
-        }
-    }
-
-    pr_info("Regulation %s",(user_value?"Enabled":"Disabled"));
     return cnt;
 }
 
@@ -199,12 +234,19 @@ int ar_init_debugfs(void)
 
     ar_dir = debugfs_create_dir("ar", NULL);
     BUG_ON(!ar_dir);
-    debugfs_create_file("regu_interval", 0444, ar_dir, NULL,
+    debugfs_create_file("regu_interval", 0644, ar_dir, NULL,
                 &ar_reg_interval_fops);
-    debugfs_create_file("obs_interval", 0444, ar_dir, NULL,
+    debugfs_create_file("obs_interval", 0644, ar_dir, NULL,
                 &ar_obs_interval_fops);
-    debugfs_create_file("enable_regulation", 0444, ar_dir, NULL,
+    debugfs_create_file("enable_regulation", 0644, ar_dir, NULL,
                         &ar_enable_reg);
+
+    ar_stats_init_debugfs(ar_dir);
+    ar_policy_init_debugfs(ar_dir);
+    ar_group_init_debugfs(ar_dir);
+    ar_probe_init_debugfs(ar_dir);
+    ar_shadow_init_debugfs(ar_dir);
+    ar_perfs_init_debugfs(ar_dir);
     return 0;
 }
 
@@ -213,6 +255,6 @@ void inline ar_remove_debugfs(void){
 }
 
 u32  get_regulation_time(void){
-	return ar_regulation_time_ms;
+	return READ_ONCE(ar_regulation_time_ms);
 }
 
@@ -21,4 +21,13 @@ void ar_remove_debugfs(void);
 u32 get_regulation_time(void);
 u32 get_sliding_window_size(void);
 
+/* Control interface shared by debugfs and netlink */
+void ar_ctrl_lock(void);
+void ar_ctrl_unlock(void);
+int set_regulation_time(u32 ms);
+int set_observation_time(u32 ms);
+u32 get_observation_time(void);
+bool regulation_enabled(void);
+void set_regulation(bool enable);
+
 #endif /* AR_DEBUGFS_H */
@@ -0,0 +1,420 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * Hierarchical bandwidth groups. Cores (e.g. the cpusets of a tenant) are
+ * placed in groups, groups may be nested, and each group has a guaranteed,
+ * max and burst bandwidth. Once per master iteration the predictions of
+ * the grouped cores are distributed top-down:
+ *
+ *   1. every child gets its demand up to its guaranteed share,
+ *   2. then, max-min fair, its demand up to its max,
+ *   3. then, from what siblings left unused, its demand up to max + burst.
+ *
+ * A group's demand is capped at max + burst of the group, so share its
+ * children do not use stays with the parent for the group's siblings.
+ *
+ * Configured through debugfs ar/groups, one command per write:
+ *   add <name> [parent=<name>] [cpus=1,2] [min=MB] [max=MB] [burst=MB]
+ *   del <name>
+ *   clear
+ * and ar/group_total_mb (0 = unlimited) for the top level.
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+
+/**************************************************************************
+ * Included Files
+ **************************************************************************/
+#include "kernel_headers.h"
+#include "ar.h"
+#include "ar_group.h"
+#include "ar_debugfs.h"
+#include "utils.h"
+#include "ar_uapi.h"
+
+/**************************************************************************
+ * Globals (protected by ar_ctrl_lock())
+ **************************************************************************/
+static struct ar_group ar_groups[AR_MAX_GROUPS];
+static s8 ar_core_group[MAX_NO_CPUS + 1] = { -1, -1, -1, -1, -1 };
+static u64 ar_group_total_mb = 0;
+
+/* Children of a group: child groups first, then its direct cores */
+#define AR_GROUP_MAX_CHILDREN (AR_MAX_GROUPS + MAX_NO_CPUS)
+
+/**************************************************************************
+ * Distribution
+ **************************************************************************/
+
+static u64 ar_sat_add(u64 a, u64 b)
+{
+    return (a + b < a) ? U64_MAX : a + b;
+}
+
+static u64 ar_group_cap(u64 max_mb)
+{
+    return max_mb ? max_mb : U64_MAX;
+}
+
+/* Current demand of a core in MB/s; parked cores want nothing */
+static u64 ar_core_demand(u8 cpu_id)
+{
+    struct core_info *cinfo = get_core_info(cpu_id);
+
+    if (READ_ONCE(cinfo->parked))
+        return 0;
+    return max_t(s64, READ_ONCE(cinfo->next_estimate), 0);
+}
+
+/* Bottom-up: demand of group @g, capped at what it may ever get */
+static u64 ar_group_want(s8 g)
+{
+    struct ar_group *grp = &ar_groups[g];
+    u64 want = 0;
+    u8 cpu_id;
+    s8 c;
+
+    for (c = 0; c < AR_MAX_GROUPS; c++)
+        if (ar_groups[c].used && ar_groups[c].parent == g)
+            want = ar_sat_add(want, ar_group_want(c));
+
+    for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++)
+        if (grp->cpus & BIT(cpu_id))
+            want = ar_sat_add(want, ar_core_demand(cpu_id));
+
+    grp->want_mb = min_t(u64, want, ar_sat_add(ar_group_cap(grp->max_mb), grp->burst_mb));
+    return grp->want_mb;
+}
+
+static void ar_core_apply(u8 cpu_id, u64 mb)
+{
+    struct core_info *cinfo = get_core_info(cpu_id);
+
+    atomic64_set(&cinfo->budget_est, convert_mb_to_events(mb));
+    WRITE_ONCE(cinfo->budget_mb, mb);
+}
+
+/* Top-down: split @avail between the children of @g (-1: top level) */
+static void ar_group_split(s8 g, u64 avail)
+{
+    u64 want[AR_GROUP_MAX_CHILDREN], lo[AR_GROUP_MAX_CHILDREN];
+    u64 mid[AR_GROUP_MAX_CHILDREN], got[AR_GROUP_MAX_CHILDREN] = { 0 };
+    s8 child[AR_GROUP_MAX_CHILDREN];    /* group index, or -cpu_id for a core */
+    bool parked[AR_GROUP_MAX_CHILDREN] = { false };
+    int n = 0;
+    int i;
+    s8 c;
+
+    for (c = 0; c < AR_MAX_GROUPS; c++) {
+        struct ar_group *grp = &ar_groups[c];
+
+        if (!grp->used || grp->parent != g)
+            continue;
+        child[n] = c;
+        want[n] = grp->want_mb;
+        lo[n] = min(want[n], grp->min_mb);
+        mid[n] = min(want[n], ar_group_cap(grp->max_mb));
+        n++;
+    }
+
+    if (g >= 0) {
+        u8 cpu_id;
+
+        for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++) {
+            if (!(ar_groups[g].cpus & BIT(cpu_id)))
+                continue;
+            child[n] = -cpu_id;
+            parked[n] = READ_ONCE(get_core_info(cpu_id)->parked);
+            want[n] = mid[n] = parked[n] ? 0 : ar_core_demand(cpu_id);
+            lo[n] = 0;
+            n++;
+        }
+    }
+
+    ar_fair_fill(got, lo, n, &avail);
+    ar_fair_fill(got, mid, n, &avail);
+    ar_fair_fill(got, want, n, &avail);
+
+    for (i = 0; i < n; i++) {
+        if (child[i] < 0) {
+            /* A parked core keeps its last budget for when it leaves idle */
+            if (!parked[i])
+                ar_core_apply(-child[i], got[i]);
+            continue;
+        }
+        ar_groups[child[i]].alloc_mb = got[i];
+        ar_group_split(child[i], got[i]);
+    }
+}
+
+/*
+ * Called by the master under ar_ctrl_lock() once all cores have their
+ * prediction for the iteration; overrides the budgets of grouped cores.
+ */
+void ar_groups_distribute(void)
+{
+    bool any = false;
+    u64 want = 0;
+    s8 g;
+
+    for (g = 0; g < AR_MAX_GROUPS; g++) {
+        if (ar_groups[g].used && ar_groups[g].parent < 0) {
+            want = ar_sat_add(want, ar_group_want(g));
+            any = true;
+        }
+    }
+
+    if (!any)
+        return;
+
+    ar_group_split(-1, ar_group_total_mb ? ar_group_total_mb : want);
+}
+
+/**************************************************************************
+ * Configuration
+ **************************************************************************/
+
+static s8 ar_group_find(const char *name)
+{
+    s8 g;
+
+    for (g = 0; g < AR_MAX_GROUPS; g++)
+        if (ar_groups[g].used && !strcmp(ar_groups[g].name, name))
+            return g;
+    return -1;
+}
+
+static bool ar_group_has_children(s8 g)
+{
+    s8 c;
+
+    for (c = 0; c < AR_MAX_GROUPS; c++)
+        if (ar_groups[c].used && ar_groups[c].parent == g)
+            return true;
+    return false;
+}
+
+static void ar_group_release_cpus(s8 g)
+{
+    u8 cpu_id;
+
+    for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++)
+        if (ar_core_group[cpu_id] == g)
+            ar_core_group[cpu_id] = -1;
+    ar_groups[g].cpus = 0;
+}
+
+/* "1,2,4" -> bitmask of regulated cores */
+static int ar_group_parse_cpus(char *list, u8 *cpus)
+{
+    char *tok;
+
+    *cpus = 0;
+    while ((tok = strsep(&list, ",")) != NULL) {
+        u8 cpu_id;
+
+        if (kstrtou8(tok, 10, &cpu_id) || cpu_id < 1 || cpu_id > MAX_NO_CPUS)
+            return -EINVAL;
+        *cpus |= BIT(cpu_id);
+    }
+    return 0;
+}
+
+/* add <name> [parent=<name>] [cpus=..] [min=..] [max=..] [burst=..]; caller holds ar_ctrl_lock() */
+static int ar_group_add(char *name, char *args)
+{
+    struct ar_group cfg = { .used = true, .parent = -1 };
+    bool has_parent = false, has_cpus = false;
+    s8 g = ar_group_find(name);
+    char *opt;
+    int ret = 0;
+
+    if (!*name || strlen(name) >= AR_GROUP_NAME_LEN)
+        return -EINVAL;
+
+    if (g >= 0)
+        cfg = ar_groups[g];
+
+    while ((opt = strsep(&args, " \t")) != NULL) {
+        char *val = opt;
+        char *key = strsep(&val, "=");
+
+        if (!*key)
+            continue;
+        if (!val)
+            return -EINVAL;
+
+        if (!strcmp(key, "parent")) {
+            cfg.parent = ar_group_find(val);
+            if (cfg.parent < 0 || cfg.parent == g)
+                return -ENOENT;
+            has_parent = true;
+        } else if (!strcmp(key, "cpus")) {
+            ret = ar_group_parse_cpus(val, &cfg.cpus);
+            has_cpus = true;
+        } else if (!strcmp(key, "min")) {
+            ret = kstrtou64(val, 10, &cfg.min_mb);
+        } else if (!strcmp(key, "max")) {
+            ret = kstrtou64(val, 10, &cfg.max_mb);
+        } else if (!strcmp(key, "burst")) {
+            ret = kstrtou64(val, 10, &cfg.burst_mb);
+        } else {
+            ret = -EINVAL;
+        }
+        if (ret)
+            return ret;
+    }
+
+    if (cfg.min_mb > AREG_BW_MAX_MB || cfg.max_mb > AREG_BW_MAX_MB ||
+        cfg.burst_mb > AREG_BW_MAX_MB)
+        return -ERANGE;
+
+    /* Re-parenting could create a cycle */
+    if (g >= 0 && has_parent && cfg.parent != ar_groups[g].parent)
+        return -EBUSY;
+
+    if (g < 0) {
+        for (g = 0; g < AR_MAX_GROUPS && ar_groups[g].used; g++)
+            ;
+        if (g == AR_MAX_GROUPS)
+            return -ENOSPC;
+        strscpy(cfg.name, name, sizeof(cfg.name));
+    }
+
+    if (has_cpus) {
+        u8 cpu_id;
+
+        ar_group_release_cpus(g);
+        for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++) {
+            if (!(cfg.cpus & BIT(cpu_id)))
+                continue;
+            /* A core belongs to one group; move it here */
+            if (ar_core_group[cpu_id] >= 0)
+                ar_groups[ar_core_group[cpu_id]].cpus &= ~BIT(cpu_id);
+            ar_core_group[cpu_id] = g;
+        }
+    }
+
+    ar_groups[g] = cfg;
+    return 0;
+}
+
+static int ar_group_del(const char *name)
+{
+    s8 g = ar_group_find(name);
+
+    if (g < 0)
+        return -ENOENT;
+    if (ar_group_has_children(g))
+        return -EBUSY;
+
+    ar_group_release_cpus(g);
+    memset(&ar_groups[g], 0, sizeof(ar_groups[g]));
+    return 0;
+}
+
+static void ar_group_clear(void)
+{
+    u8 cpu_id;
+
+    memset(ar_groups, 0, sizeof(ar_groups));
+    for (cpu_id = 0; cpu_id <= MAX_NO_CPUS; cpu_id++)
+        ar_core_group[cpu_id] = -1;
+}
+
+/**************************************************************************
+ * debugfs
+ **************************************************************************/
+
+static void ar_group_show_one(struct seq_file *m, s8 g, int depth)
+{
+    struct ar_group *grp = &ar_groups[g];
+    const char *sep = "";
+    u8 cpu_id;
+    s8 c;
+
+    seq_printf(m, "%*s%-*s cpus=", depth * 2, "", AR_GROUP_NAME_LEN, grp->name);
+    for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++) {
+        if (grp->cpus & BIT(cpu_id)) {
+            seq_printf(m, "%s%u", sep, cpu_id);
+            sep = ",";
+        }
+    }
+    seq_printf(m, "%s min=%llu max=%llu burst=%llu want=%llu alloc=%llu\n",
+               *sep ? "" : "-", grp->min_mb, grp->max_mb, grp->burst_mb,
+               grp->want_mb, grp->alloc_mb);
+
+    for (c = 0; c < AR_MAX_GROUPS; c++)
+        if (ar_groups[c].used && ar_groups[c].parent == g)
+            ar_group_show_one(m, c, depth + 1);
+}
+
+static int ar_groups_show(struct seq_file *m, void *v)
+{
+    s8 g;
+
+    ar_ctrl_lock();
+    for (g = 0; g < AR_MAX_GROUPS; g++)
+        if (ar_groups[g].used && ar_groups[g].parent < 0)
+            ar_group_show_one(m, g, 0);
+    ar_ctrl_unlock();
+    return 0;
+}
+
+static int ar_groups_open(struct inode *inode, struct file *filp)
+{
+    return single_open(filp, ar_groups_show, NULL);
+}
+
+static ssize_t ar_groups_write(struct file *filp, const char __user *ubuf,
+                               size_t cnt, loff_t *ppos)
+{
+    char *buf, *args, *cmd, *name;
+    int ret;
+
+    /* One command per write; a longer one would be cut short */
+    if (cnt >= PAGE_SIZE)
+        return -E2BIG;
+
+    buf = memdup_user_nul(ubuf, cnt);
+    if (IS_ERR(buf))
+        return PTR_ERR(buf);
+
+    args = strim(buf);
+    cmd = strsep(&args, " \t");
+    name = args ? strsep(&args, " \t") : NULL;
+
+    ar_ctrl_lock();
+    if (!strcmp(cmd, "clear")) {
+        ar_group_clear();
+        ret = 0;
+    } else if (!strcmp(cmd, "add") && name) {
+        ret = ar_group_add(name, args ? args : "");
+    } else if (!strcmp(cmd, "del") && name) {
+        ret = ar_group_del(name);
+    } else {
+        ret = -EINVAL;
+    }
+    ar_ctrl_unlock();
+
+    if (ret)
+        pr_err("%s: '%s' failed (%d)", __func__, cmd, ret);
+    kfree(buf);
+    return ret ? ret : cnt;
+}
+
+static const struct file_operations ar_groups_fops = {
+    .open       = ar_groups_open,
+    .write      = ar_groups_write,
+    .read       = seq_read,
+    .llseek     = seq_lseek,
+    .release    = single_release,
+};
+
+void ar_group_init_debugfs(struct dentry *dir)
+{
+    debugfs_create_file("groups", 0644, dir, NULL, &ar_groups_fops);
+    debugfs_create_u64("group_total_mb", 0644, dir, &ar_group_total_mb);
+}
@@ -0,0 +1,37 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#if !defined AR_GROUP_H
+#define AR_GROUP_H
+
+#define AR_MAX_GROUPS 8
+#define AR_GROUP_NAME_LEN 16
+
+/* A bandwidth group: a set of cores and/or child groups sharing an SLA */
+struct ar_group {
+    bool used;
+    char name[AR_GROUP_NAME_LEN];
+    s8 parent;          /* index of the parent group, -1 for top level */
+    u8 cpus;            /* bit n set: core n is a direct member */
+
+    /* MB/s; max_mb == 0 means unlimited */
+    u64 min_mb;         /* guaranteed share */
+    u64 max_mb;         /* share out of the parent's allocation */
+    u64 burst_mb;       /* extra above max_mb, from unused sibling share */
+
+    /* Computed by ar_groups_distribute() */
+    u64 want_mb;
+    u64 alloc_mb;
+};
+
+struct dentry;
+
+void ar_groups_distribute(void);
+void ar_group_init_debugfs(struct dentry *dir);
+
+#endif /* AR_GROUP_H */
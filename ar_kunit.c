@@ -0,0 +1,556 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * KUnit suites for the regulator's arithmetic and its per-core state
+ * machine. Built with the rest of the module sources into areg_kunit.ko
+ * (make kunit), which runs the suites on load and starts nothing else:
+ *
+ *   make kunit && insmod areg_kunit.ko    # results in dmesg / debugfs kunit/
+ *
+ * The overflow/throttle/unthrottle tests drive ar_core_overflow() and
+ * ar_core_new_interval() with a fake counter: a struct perf_event whose
+ * pmu only tracks started/stopped and which "overflows" when the test
+ * feeds it more events than its period, like the PMU interrupt would.
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+
+/**************************************************************************
+ * Included Files
+ **************************************************************************/
+#include "kernel_headers.h"
+#include <kunit/test.h>
+#include "ar.h"
+#include "ar_budget.h"
+#include "ar_debugfs.h"
+#include "ar_perfs.h"
+#include "model.h"
+#include "utils.h"
+
+/**************************************************************************
+ * Helpers
+ **************************************************************************/
+
+/* Set the regulation time to @ms; returns the previous one for restoring */
+static u32 ar_test_set_interval(u32 ms)
+{
+    u32 old = get_regulation_time();
+
+    ar_ctrl_lock();
+    set_regulation_time(ms);
+    ar_ctrl_unlock();
+    return old;
+}
+
+/**************************************************************************
+ * Conversions
+ **************************************************************************/
+
+static void ar_test_convert_1ms(struct kunit *test)
+{
+    u32 old = ar_test_set_interval(1);
+
+    /* 1000 MB/s for 1 ms = 1000 * 2^20 / 1000 / 64 lines */
+    KUNIT_EXPECT_EQ(test, convert_mb_to_events(1000), 16384ULL);
+    KUNIT_EXPECT_EQ(test, convert_events_to_mb(16384), 1000ULL);
+    KUNIT_EXPECT_EQ(test, convert_mb_to_events(0), 0ULL);
+    KUNIT_EXPECT_EQ(test, convert_events_to_mb(0), 0ULL);
+    /* Partial MBs round up */
+    KUNIT_EXPECT_EQ(test, convert_events_to_mb(1), 1ULL);
+
+    ar_test_set_interval(old);
+}
+
+static void ar_test_convert_round_trip(struct kunit *test)
+{
+    static const u32 intervals[] = { 1, 2, 3, 7, 10, 250, 1000, 1500, 2000, 60000 };
+    u32 old = get_regulation_time();
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(intervals); i++) {
+        u64 mb;
+
+        ar_test_set_interval(intervals[i]);
+        /* Intervals that do not divide a second used to be truncated, and
+         * those above 1000 ms divided by zero */
+        KUNIT_EXPECT_EQ_MSG(test, convert_mb_to_events(1000),
+                            div_u64(1000ULL * 1024 * 1024 * intervals[i], 64 * 1000),
+                            "interval %u ms", intervals[i]);
+        for (mb = 1; mb <= 1000000; mb *= 10)
+            KUNIT_EXPECT_EQ_MSG(test, convert_events_to_mb(convert_mb_to_events(mb)), mb,
+                                "%llu MB/s, interval %u ms", mb, intervals[i]);
+    }
+
+    ar_test_set_interval(old);
+}
+
+static void ar_test_convert_no_int_truncation(struct kunit *test)
+{
+    u32 old = ar_test_set_interval(1);
+
+    /* Above INT_MAX in both directions */
+    KUNIT_EXPECT_EQ(test, convert_events_to_mb(1ULL << 40), 64000ULL << 20);
+    KUNIT_EXPECT_EQ(test, convert_mb_to_events(3000000000ULL), 3000000000ULL * 16384 / 1000);
+
+    ar_test_set_interval(old);
+}
+
+/**************************************************************************
+ * Predictor
+ **************************************************************************/
+
+/* Weight k applies to the sample k intervals before ri, wrapping around */
+static void ar_test_lms_ring_walk(struct kunit *test)
+{
+    u64 feat[HIST_SIZE];
+    double wm[HIST_SIZE];
+    u8 ri, k, i;
+
+    for (i = 0; i < HIST_SIZE; i++)
+        feat[i] = 100 * (i + 1);
+
+    for (ri = 0; ri < HIST_SIZE; ri++) {
+        for (k = 0; k < HIST_SIZE; k++) {
+            kernel_fpu_begin();
+            for (i = 0; i < HIST_SIZE; i++)
+                wm[i] = (i == k) ? 1.0 : 0.0;
+            kernel_fpu_end();
+
+            KUNIT_EXPECT_EQ_MSG(test, estimate(feat, HIST_SIZE, wm, HIST_SIZE, ri),
+                                feat[(ri + HIST_SIZE - k) % HIST_SIZE],
+                                "ri=%u weight=%u", ri, k);
+        }
+    }
+}
+
+static void ar_test_lms_sum(struct kunit *test)
+{
+    u64 feat[HIST_SIZE];
+    double wm[HIST_SIZE];
+    u64 sum = 0;
+    u8 i;
+
+    for (i = 0; i < HIST_SIZE; i++) {
+        feat[i] = 1000 * (i + 1);
+        sum += feat[i];
+    }
+    kernel_fpu_begin();
+    for (i = 0; i < HIST_SIZE; i++)
+        wm[i] = 0.5;
+    kernel_fpu_end();
+
+    KUNIT_EXPECT_EQ(test, estimate(feat, HIST_SIZE, wm, HIST_SIZE, 0), sum / 2);
+}
+
+struct ar_lms_ctx {
+    struct core_info *cinfo;
+    u32 lrate_ppb;
+};
+
+static int ar_lms_init(struct kunit *test)
+{
+    struct ar_lms_ctx *ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+
+    KUNIT_ASSERT_NOT_NULL(test, ctx);
+    ctx->cinfo = kunit_kzalloc(test, sizeof(*ctx->cinfo), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, ctx->cinfo);
+    ctx->lrate_ppb = ar_lrate_ppb;
+    WRITE_ONCE(ar_lrate_ppb, 1000);
+    initialize_weight_matrix(ctx->cinfo, true);
+    test->priv = ctx;
+    return 0;
+}
+
+static void ar_lms_exit(struct kunit *test)
+{
+    struct ar_lms_ctx *ctx = test->priv;
+
+    WRITE_ONCE(ar_lrate_ppb, ctx->lrate_ppb);
+}
+
+static void ar_test_lms_zero_history(struct kunit *test)
+{
+    struct core_info *cinfo = ((struct ar_lms_ctx *)test->priv)->cinfo;
+    double before[HIST_SIZE];
+
+    memcpy(before, cinfo->weight_matrix, sizeof(before));
+    update_weight_matrix(12345, cinfo);
+    KUNIT_EXPECT_EQ(test, memcmp(before, cinfo->weight_matrix, sizeof(before)), 0);
+}
+
+/* The step is lrate * |error| * h[i] / norm_sq, with the sign of the error */
+static void ar_test_lms_step_size(struct kunit *test)
+{
+    struct core_info *cinfo = ((struct ar_lms_ctx *)test->priv)->cinfo;
+    s64 up_ppb, down_ppb;
+    double w0;
+
+    /* h = (2^16, 0, ...): norm_sq = 2^32 >> 16 = 2^16 */
+    cinfo->read_event_hist[0] = 1 << 16;
+
+    kernel_fpu_begin();
+    w0 = cinfo->weight_matrix[0];
+    kernel_fpu_end();
+
+    update_weight_matrix(1 << 16, cinfo);
+    kernel_fpu_begin();
+    up_ppb = (s64)((cinfo->weight_matrix[0] - w0) * 1e9 + 0.5);
+    kernel_fpu_end();
+
+    update_weight_matrix(-(1 << 16), cinfo);
+    update_weight_matrix(-(1 << 16), cinfo);
+    kernel_fpu_begin();
+    down_ppb = (s64)((cinfo->weight_matrix[0] - w0) * 1e9 - 0.5);
+    kernel_fpu_end();
+
+    /* 2^16 * 2^16 / 2^16 * 1000e-9 */
+    KUNIT_EXPECT_EQ(test, up_ppb, 65536000LL);
+    KUNIT_EXPECT_EQ(test, down_ppb, -65536000LL);
+}
+
+/* +e then -e restores the weights: the split only moves the sign */
+static void ar_test_lms_sign_symmetry(struct kunit *test)
+{
+    struct core_info *cinfo = ((struct ar_lms_ctx *)test->priv)->cinfo;
+    double before[HIST_SIZE];
+    bool moved = false, restored = true;
+    u8 i;
+
+    for (i = 0; i < HIST_SIZE; i++)
+        cinfo->read_event_hist[i] = (u64)(i + 1) * 3000;
+    memcpy(before, cinfo->weight_matrix, sizeof(before));
+
+    update_weight_matrix(5000, cinfo);
+    kernel_fpu_begin();
+    for (i = 0; i < HIST_SIZE; i++)
+        moved |= cinfo->weight_matrix[i] > before[i];
+    kernel_fpu_end();
+
+    update_weight_matrix(-5000, cinfo);
+    kernel_fpu_begin();
+    for (i = 0; i < HIST_SIZE; i++) {
+        double d = cinfo->weight_matrix[i] - before[i];
+
+        restored &= d < 1e-12 && d > -1e-12;
+    }
+    kernel_fpu_end();
+
+    KUNIT_EXPECT_TRUE(test, moved);
+    KUNIT_EXPECT_TRUE(test, restored);
+}
+
+/* A negative estimate halves the weights and keeps the history slot */
+static void ar_test_model_negative(struct kunit *test)
+{
+    struct core_info *cinfo = ((struct ar_lms_ctx *)test->priv)->cinfo;
+    s64 half_ppm, error = 0;
+    u8 i;
+
+    kernel_fpu_begin();
+    for (i = 0; i < HIST_SIZE; i++)
+        cinfo->weight_matrix[i] = -1.0;
+    kernel_fpu_end();
+    cinfo->ri = 0;
+
+    KUNIT_EXPECT_FALSE(test, model_step(cinfo, 10000, 100, &error));
+    KUNIT_EXPECT_EQ(test, (int)cinfo->ri, 0);
+    kernel_fpu_begin();
+    half_ppm = (s64)(cinfo->weight_matrix[0] * 1e6 - 0.5);
+    kernel_fpu_end();
+    KUNIT_EXPECT_EQ(test, half_ppm, -500000LL);
+}
+
+/**************************************************************************
+ * Budget logic
+ **************************************************************************/
+
+static void ar_test_bucket(struct kunit *test)
+{
+    struct ar_bucket b;
+
+    ar_bucket_reset(&b);
+
+    /* No carry over */
+    KUNIT_EXPECT_EQ(test, ar_bucket_fill(&b, 1000, 0, 0), 1000ULL);
+    KUNIT_EXPECT_EQ(test, ar_bucket_fill(&b, 1000, 100, 0), 1000ULL);
+
+    /* 900 left over, capped at 200% of the refill */
+    ar_bucket_reset(&b);
+    KUNIT_EXPECT_EQ(test, ar_bucket_fill(&b, 1000, 0, 200), 1000ULL);
+    KUNIT_EXPECT_EQ(test, ar_bucket_fill(&b, 1000, 100, 200), 1900ULL);
+    KUNIT_EXPECT_EQ(test, ar_bucket_fill(&b, 1000, 100, 200), 2000ULL);
+
+    /* Overshoot leaves nothing to carry */
+    KUNIT_EXPECT_EQ(test, ar_bucket_fill(&b, 1000, 100 + 5000, 200), 1000ULL);
+}
+
+static void ar_test_fair_fill(struct kunit *test)
+{
+    u64 cap[3] = { 100, 500, 1000 };
+    u64 got[3] = { 0 };
+    u64 avail = 900;
+
+    ar_fair_fill(got, cap, 3, &avail);
+    KUNIT_EXPECT_EQ(test, got[0], 100ULL);
+    KUNIT_EXPECT_EQ(test, got[1], 400ULL);
+    KUNIT_EXPECT_EQ(test, got[2], 400ULL);
+    KUNIT_EXPECT_EQ(test, avail, 0ULL);
+
+    /* Everyone satisfied: the rest stays available */
+    memset(got, 0, sizeof(got));
+    avail = 5000;
+    ar_fair_fill(got, cap, 3, &avail);
+    KUNIT_EXPECT_EQ(test, got[2], 1000ULL);
+    KUNIT_EXPECT_EQ(test, avail, 3400ULL);
+}
+
+static void ar_test_gate(struct kunit *test)
+{
+    struct ar_gate_marks m = { .high_mb = 1000, .low_mb = 500, .hold = 3 };
+    struct ar_gate_marks off = { 0 };
+    struct ar_gate gate = { .regulating = true };
+
+    KUNIT_EXPECT_TRUE(test, ar_gate_step(&gate, &off, 0, 0));
+
+    /* Opens only after hold iterations below the low mark */
+    KUNIT_EXPECT_TRUE(test, ar_gate_step(&gate, &m, 400, 0));
+    KUNIT_EXPECT_TRUE(test, ar_gate_step(&gate, &m, 400, 0));
+    KUNIT_EXPECT_FALSE(test, ar_gate_step(&gate, &m, 400, 0));
+
+    /* Between the marks it stays open; at the high mark it closes */
+    KUNIT_EXPECT_FALSE(test, ar_gate_step(&gate, &m, 800, 0));
+    KUNIT_EXPECT_TRUE(test, ar_gate_step(&gate, &m, 1000, 0));
+
+    /* A sample above low restarts the hold count */
+    KUNIT_EXPECT_TRUE(test, ar_gate_step(&gate, &m, 400, 0));
+    KUNIT_EXPECT_TRUE(test, ar_gate_step(&gate, &m, 600, 0));
+    KUNIT_EXPECT_TRUE(test, ar_gate_step(&gate, &m, 400, 0));
+    KUNIT_EXPECT_TRUE(test, ar_gate_step(&gate, &m, 400, 0));
+    KUNIT_EXPECT_EQ(test, gate.transitions, 2ULL);
+}
+
+/**************************************************************************
+ * Overflow / throttle / unthrottle with a fake counter
+ **************************************************************************/
+
+struct ar_fake_counter {
+    struct perf_event event;
+    struct core_info *cinfo;
+    u32 overflows;
+};
+
+static void ar_fake_pmu_start(struct perf_event *event, int flags)
+{
+    event->hw.state = 0;
+}
+
+static void ar_fake_pmu_stop(struct perf_event *event, int flags)
+{
+    event->hw.state |= PERF_HES_STOPPED;
+}
+
+static void ar_fake_pmu_read(struct perf_event *event)
+{
+}
+
+static struct pmu ar_fake_pmu = {
+    .start      = ar_fake_pmu_start,
+    .stop       = ar_fake_pmu_stop,
+    .read       = ar_fake_pmu_read,
+};
+
+/* Overflow "interrupt": what read_event_overflow_callback and its irq_work do */
+static void ar_fake_overflow(struct perf_event *event, struct perf_sample_data *data,
+                             struct pt_regs *regs)
+{
+    struct ar_fake_counter *fc = container_of(event, struct ar_fake_counter, event);
+
+    fc->overflows++;
+    ar_core_overflow(fc->cinfo);
+}
+
+/* The core causes @events misses; a stopped counter does not count */
+static void ar_fake_count(struct ar_fake_counter *fc, u64 events)
+{
+    struct perf_event *event = &fc->event;
+
+    if (event->hw.state & PERF_HES_STOPPED)
+        return;
+
+    local64_add(events, &event->count);
+    if (local64_sub_return(events, &event->hw.period_left) <= 0) {
+        local64_set(&event->hw.period_left, event->hw.sample_period);
+        event->overflow_handler(event, NULL, NULL);
+    }
+}
+
+/* The regulation timer: stop, new interval, restart */
+static void ar_fake_timer(struct ar_fake_counter *fc)
+{
+    struct perf_event *event = &fc->event;
+
+    event->pmu->stop(event, PERF_EF_UPDATE);
+    ar_core_new_interval(fc->cinfo);
+    event->pmu->start(event, PERF_EF_RELOAD);
+}
+
+static int ar_sm_init(struct kunit *test)
+{
+    struct ar_fake_counter *fc = kunit_kzalloc(test, sizeof(*fc), GFP_KERNEL);
+    struct core_info *cinfo = kunit_kzalloc(test, sizeof(*cinfo), GFP_KERNEL);
+
+    KUNIT_ASSERT_NOT_NULL(test, fc);
+    KUNIT_ASSERT_NOT_NULL(test, cinfo);
+
+    cinfo->cpu_id = 1;
+    init_waitqueue_head(&cinfo->throttle_evt);
+    atomic_set(&cinfo->throttler_task, false);
+    ar_adapt_reset(&cinfo->adapt);
+    ar_bucket_reset(&cinfo->bucket);
+    atomic64_set(&cinfo->budget_est, 16384);
+    cinfo->budget_mb = 1000;
+
+    fc->cinfo = cinfo;
+    fc->event.cpu = 1;
+    fc->event.pmu = &ar_fake_pmu;
+    fc->event.overflow_handler = ar_fake_overflow;
+    fc->event.hw.sample_period = 16384;
+    fc->event.hw.state = PERF_HES_STOPPED;
+    cinfo->read_event = &fc->event;
+
+    /* First interval */
+    ar_fake_timer(fc);
+    test->priv = fc;
+    return 0;
+}
+
+static void ar_test_sm_under_budget(struct kunit *test)
+{
+    struct ar_fake_counter *fc = test->priv;
+    struct core_info *cinfo = fc->cinfo;
+    u64 nr_over = cinfo->acc.nr_over;
+
+    KUNIT_EXPECT_EQ(test, (u64)local64_read(&fc->event.hw.period_left), 16384ULL);
+    ar_fake_count(fc, 16000);
+    KUNIT_EXPECT_EQ(test, fc->overflows, 0U);
+    KUNIT_EXPECT_FALSE(test, atomic_read(&cinfo->throttler_task));
+
+    ar_fake_timer(fc);
+    KUNIT_EXPECT_EQ(test, cinfo->acc.nr_over, nr_over + 1);
+    /* Re-armed with the full budget, not what was left of it */
+    KUNIT_EXPECT_EQ(test, (u64)local64_read(&fc->event.hw.period_left), 16384ULL);
+}
+
+static void ar_test_sm_overflow_throttles(struct kunit *test)
+{
+    struct ar_fake_counter *fc = test->priv;
+    struct core_info *cinfo = fc->cinfo;
+
+    WRITE_ONCE(cinfo->adapt.shift, 2);
+    ar_fake_count(fc, 10000);
+    ar_fake_count(fc, 6384);
+
+    KUNIT_EXPECT_EQ(test, fc->overflows, 1U);
+    KUNIT_EXPECT_TRUE(test, atomic_read(&cinfo->throttler_task));
+    KUNIT_EXPECT_TRUE(test, cinfo->overflowed);
+    KUNIT_EXPECT_EQ(test, atomic64_read(&cinfo->pmu_count[AR_PMU_OVERFLOWS]), 1LL);
+    /* An overflow snaps the adaptive interval back */
+    KUNIT_EXPECT_EQ(test, (int)READ_ONCE(cinfo->adapt.shift), 0);
+}
+
+static void ar_test_sm_unthrottle(struct kunit *test)
+{
+    struct ar_fake_counter *fc = test->priv;
+    struct core_info *cinfo = fc->cinfo;
+    u64 nr_under = cinfo->acc.nr_under;
+    s64 intervals = atomic64_read(&cinfo->pmu_count[AR_PMU_INTERVALS]);
+
+    ar_fake_count(fc, 20000);
+    KUNIT_ASSERT_TRUE(test, atomic_read(&cinfo->throttler_task));
+
+    ar_fake_timer(fc);
+    KUNIT_EXPECT_FALSE(test, atomic_read(&cinfo->throttler_task));
+    KUNIT_EXPECT_FALSE(test, cinfo->overflowed);
+    KUNIT_EXPECT_EQ(test, cinfo->lat.t_overflow, 0ULL);
+    KUNIT_EXPECT_EQ(test, cinfo->acc.nr_under, nr_under + 1);
+    KUNIT_EXPECT_EQ(test, atomic64_read(&cinfo->pmu_count[AR_PMU_INTERVALS]), intervals + 1);
+    KUNIT_EXPECT_EQ(test, (u64)local64_read(&fc->event.hw.period_left), 16384ULL);
+
+    /* Runs again and overflows again on the next exhausted budget */
+    ar_fake_count(fc, 16384);
+    KUNIT_EXPECT_EQ(test, fc->overflows, 2U);
+    KUNIT_EXPECT_TRUE(test, atomic_read(&cinfo->throttler_task));
+}
+
+static void ar_test_sm_stopped_counter(struct kunit *test)
+{
+    struct ar_fake_counter *fc = test->priv;
+
+    fc->event.pmu->stop(&fc->event, 0);
+    ar_fake_count(fc, 1 << 20);
+    KUNIT_EXPECT_EQ(test, fc->overflows, 0U);
+    KUNIT_EXPECT_FALSE(test, atomic_read(&fc->cinfo->throttler_task));
+}
+
+/**************************************************************************
+ * Suites
+ **************************************************************************/
+
+static struct kunit_case ar_convert_cases[] = {
+    KUNIT_CASE(ar_test_convert_1ms),
+    KUNIT_CASE(ar_test_convert_round_trip),
+    KUNIT_CASE(ar_test_convert_no_int_truncation),
+    {}
+};
+
+static struct kunit_suite ar_convert_suite = {
+    .name = "areg_convert",
+    .test_cases = ar_convert_cases,
+};
+
+static struct kunit_case ar_lms_cases[] = {
+    KUNIT_CASE(ar_test_lms_ring_walk),
+    KUNIT_CASE(ar_test_lms_sum),
+    KUNIT_CASE(ar_test_lms_zero_history),
+    KUNIT_CASE(ar_test_lms_step_size),
+    KUNIT_CASE(ar_test_lms_sign_symmetry),
+    KUNIT_CASE(ar_test_model_negative),
+    {}
+};
+
+static struct kunit_suite ar_lms_suite = {
+    .name = "areg_lms",
+    .init = ar_lms_init,
+    .exit = ar_lms_exit,
+    .test_cases = ar_lms_cases,
+};
+
+static struct kunit_case ar_budget_cases[] = {
+    KUNIT_CASE(ar_test_bucket),
+    KUNIT_CASE(ar_test_fair_fill),
+    KUNIT_CASE(ar_test_gate),
+    {}
+};
+
+static struct kunit_suite ar_budget_suite = {
+    .name = "areg_budget",
+    .test_cases = ar_budget_cases,
+};
+
+static struct kunit_case ar_sm_cases[] = {
+    KUNIT_CASE(ar_test_sm_under_budget),
+    KUNIT_CASE(ar_test_sm_overflow_throttles),
+    KUNIT_CASE(ar_test_sm_unthrottle),
+    KUNIT_CASE(ar_test_sm_stopped_counter),
+    {}
+};
+
+static struct kunit_suite ar_sm_suite = {
+    .name = "areg_state_machine",
+    .init = ar_sm_init,
+    .test_cases = ar_sm_cases,
+};
+
+kunit_test_suites(&ar_convert_suite, &ar_lms_suite, &ar_budget_suite, &ar_sm_suite);
@@ -0,0 +1,326 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * Generic netlink control and event channel (family "areg", see ar_uapi.h).
+ * A single AREG_CMD_SET reconfigures any number of cores atomically with
+ * respect to the master; AREG_CMD_EVENT streams per-core budgets and
+ * throttle counters to the "events" multicast group.
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+
+/**************************************************************************
+ * Included Files
+ **************************************************************************/
+#include "kernel_headers.h"
+#include <net/genetlink.h>
+#include "ar.h"
+#include "ar_debugfs.h"
+#include "ar_netlink.h"
+#include "ar_uapi.h"
+
+/**************************************************************************
+ * External Variables
+ **************************************************************************/
+extern u64 g_bw_intial_setpoint_mb[MAX_NO_CPUS+1];
+extern u64 g_bw_max_mb[MAX_NO_CPUS+1];
+
+/**************************************************************************
+ * Policies
+ **************************************************************************/
+/* NLA_POLICY_RANGE only holds s16 bounds */
+static const struct netlink_range_validation ar_nl_regu_range = {
+    .min = 1,
+    .max = AREG_REGU_INTERVAL_MAX_MS,
+};
+
+static const struct netlink_range_validation ar_nl_bw_range = {
+    .max = AREG_BW_MAX_MB,
+};
+
+static const struct nla_policy ar_nl_core_policy[AREG_CORE_A_MAX + 1] = {
+    [AREG_CORE_A_CPU]         = { .type = NLA_U32 },
+    [AREG_CORE_A_SETPOINT_MB] = NLA_POLICY_FULL_RANGE(NLA_U64, &ar_nl_bw_range),
+    [AREG_CORE_A_MAX_MB]      = NLA_POLICY_FULL_RANGE(NLA_U64, &ar_nl_bw_range),
+    [AREG_CORE_A_PREDICTOR]   = NLA_POLICY_MAX(NLA_U8, AREG_NR_PREDICTORS - 1),
+};
+
+static const struct nla_policy ar_nl_policy[AREG_A_MAX + 1] = {
+    [AREG_A_REGU_INTERVAL_MS] = NLA_POLICY_FULL_RANGE(NLA_U32, &ar_nl_regu_range),
+    [AREG_A_OBS_INTERVAL_MS]  = NLA_POLICY_MIN(NLA_U32, 1),
+    [AREG_A_ENABLE]           = NLA_POLICY_MAX(NLA_U8, 1),
+    [AREG_A_CORES]            = { .type = NLA_NESTED },
+};
+
+static struct genl_family ar_genl_family;
+static bool ar_nl_registered;
+
+enum ar_nl_mcgrps {
+    AR_NL_MCGRP_EVENTS = 0,
+};
+
+static const struct genl_multicast_group ar_nl_mcgrps[] = {
+    [AR_NL_MCGRP_EVENTS] = { .name = AREG_GENL_MCGRP_EVENTS },
+};
+
+/**************************************************************************
+ * Message helpers
+ **************************************************************************/
+
+/* Per-core state; @config adds the writable attributes */
+static int ar_nl_put_core(struct sk_buff *skb, u8 cpu_id, bool config)
+{
+    struct core_info *cinfo = get_core_info(cpu_id);
+    struct nlattr *core = nla_nest_start(skb, AREG_A_CORE);
+
+    if (!core)
+        return -EMSGSIZE;
+
+    if (nla_put_u32(skb, AREG_CORE_A_CPU, cpu_id))
+        goto nla_put_failure;
+
+    if (config &&
+        (nla_put_u64_64bit(skb, AREG_CORE_A_SETPOINT_MB,
+                           READ_ONCE(g_bw_intial_setpoint_mb[cpu_id]), AREG_CORE_A_PAD) ||
+         nla_put_u64_64bit(skb, AREG_CORE_A_MAX_MB,
+                           READ_ONCE(g_bw_max_mb[cpu_id]), AREG_CORE_A_PAD) ||
+         nla_put_u8(skb, AREG_CORE_A_PREDICTOR, READ_ONCE(cinfo->predictor))))
+        goto nla_put_failure;
+
+    if (nla_put_u64_64bit(skb, AREG_CORE_A_USED_MB,
+                          READ_ONCE(cinfo->g_read_count_used), AREG_CORE_A_PAD) ||
+        nla_put_s64(skb, AREG_CORE_A_PREDICTED_MB,
+                    READ_ONCE(cinfo->next_estimate), AREG_CORE_A_PAD) ||
+        nla_put_u64_64bit(skb, AREG_CORE_A_BUDGET_MB,
+                          READ_ONCE(cinfo->budget_mb), AREG_CORE_A_PAD) ||
+        nla_put_u64_64bit(skb, AREG_CORE_A_OVERFLOWS,
+                          atomic64_read(&cinfo->pmu_count[AR_PMU_OVERFLOWS]), AREG_CORE_A_PAD) ||
+        nla_put_u64_64bit(skb, AREG_CORE_A_THROTTLED_NS,
+                          atomic64_read(&cinfo->pmu_count[AR_PMU_THROTTLED_NS]), AREG_CORE_A_PAD) ||
+        nla_put_u8(skb, AREG_CORE_A_THROTTLED, atomic_read(&cinfo->throttler_task)))
+        goto nla_put_failure;
+
+    nla_nest_end(skb, core);
+    return 0;
+
+nla_put_failure:
+    nla_nest_cancel(skb, core);
+    return -EMSGSIZE;
+}
+
+static int ar_nl_put_cores(struct sk_buff *skb, bool config)
+{
+    struct nlattr *cores = nla_nest_start(skb, AREG_A_CORES);
+    u8 cpu_id;
+
+    if (!cores)
+        return -EMSGSIZE;
+
+    for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++) {
+        if (ar_nl_put_core(skb, cpu_id, config)) {
+            nla_nest_cancel(skb, cores);
+            return -EMSGSIZE;
+        }
+    }
+
+    nla_nest_end(skb, cores);
+    return 0;
+}
+
+/**************************************************************************
+ * Command handlers
+ **************************************************************************/
+
+static int ar_nl_get(struct sk_buff *skb, struct genl_info *info)
+{
+    struct sk_buff *msg;
+    void *hdr;
+
+    msg = genlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
+    if (!msg)
+        return -ENOMEM;
+
+    hdr = genlmsg_put_reply(msg, info, &ar_genl_family, 0, AREG_CMD_GET);
+    if (!hdr)
+        goto nla_put_failure;
+
+    ar_ctrl_lock();
+    if (nla_put_u32(msg, AREG_A_REGU_INTERVAL_MS, get_regulation_time()) ||
+        nla_put_u32(msg, AREG_A_OBS_INTERVAL_MS, get_observation_time()) ||
+        nla_put_u8(msg, AREG_A_ENABLE, regulation_enabled()) ||
+        ar_nl_put_cores(msg, true)) {
+        ar_ctrl_unlock();
+        goto nla_put_failure;
+    }
+    ar_ctrl_unlock();
+
+    genlmsg_end(msg, hdr);
+    return genlmsg_reply(msg, info);
+
+nla_put_failure:
+    nlmsg_free(msg);
+    return -EMSGSIZE;
+}
+
+/* One parsed AREG_A_CORE entry of a SET request */
+struct ar_nl_core_cfg {
+    struct nlattr *tb[AREG_CORE_A_MAX + 1];
+};
+
+static int ar_nl_set(struct sk_buff *skb, struct genl_info *info)
+{
+    struct ar_nl_core_cfg cfg[MAX_NO_CPUS + 1];
+    bool seen[MAX_NO_CPUS + 1] = { false };
+    struct nlattr *core;
+    u8 cpu_id;
+    int rem;
+    int ret;
+
+    /* Validate the whole request before touching any state */
+    if (info->attrs[AREG_A_CORES]) {
+        nla_for_each_nested(core, info->attrs[AREG_A_CORES], rem) {
+            struct nlattr *tb[AREG_CORE_A_MAX + 1];
+            u32 cpu;
+
+            if (nla_type(core) != AREG_A_CORE)
+                continue;
+
+            ret = nla_parse_nested(tb, AREG_CORE_A_MAX, core,
+                                   ar_nl_core_policy, info->extack);
+            if (ret)
+                return ret;
+
+            if (!tb[AREG_CORE_A_CPU]) {
+                NL_SET_ERR_MSG(info->extack, "core entry without cpu");
+                return -EINVAL;
+            }
+
+            cpu = nla_get_u32(tb[AREG_CORE_A_CPU]);
+            if (cpu < 1 || cpu > MAX_NO_CPUS || seen[cpu]) {
+                NL_SET_ERR_MSG_ATTR(info->extack, tb[AREG_CORE_A_CPU],
+                                    "invalid or duplicate cpu");
+                return -EINVAL;
+            }
+
+            seen[cpu] = true;
+            memcpy(cfg[cpu].tb, tb, sizeof(tb));
+        }
+    }
+
+    ar_ctrl_lock();
+
+    if (info->attrs[AREG_A_REGU_INTERVAL_MS])
+        set_regulation_time(nla_get_u32(info->attrs[AREG_A_REGU_INTERVAL_MS]));
+
+    if (info->attrs[AREG_A_OBS_INTERVAL_MS])
+        set_observation_time(nla_get_u32(info->attrs[AREG_A_OBS_INTERVAL_MS]));
+
+    for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++) {
+        struct nlattr **tb = cfg[cpu_id].tb;
+
+        if (!seen[cpu_id])
+            continue;
+
+        if (tb[AREG_CORE_A_SETPOINT_MB])
+            WRITE_ONCE(g_bw_intial_setpoint_mb[cpu_id],
+                       nla_get_u64(tb[AREG_CORE_A_SETPOINT_MB]));
+        if (tb[AREG_CORE_A_MAX_MB])
+            WRITE_ONCE(g_bw_max_mb[cpu_id], nla_get_u64(tb[AREG_CORE_A_MAX_MB]));
+        if (tb[AREG_CORE_A_PREDICTOR])
+            WRITE_ONCE(get_core_info(cpu_id)->predictor,
+                       nla_get_u8(tb[AREG_CORE_A_PREDICTOR]));
+    }
+
+    if (info->attrs[AREG_A_ENABLE])
+        set_regulation(nla_get_u8(info->attrs[AREG_A_ENABLE]));
+
+    ar_ctrl_unlock();
+    return 0;
+}
+
+static const struct genl_small_ops ar_nl_ops[] = {
+    {
+        .cmd    = AREG_CMD_GET,
+        .doit   = ar_nl_get,
+    },
+    {
+        .cmd    = AREG_CMD_SET,
+        .doit   = ar_nl_set,
+        .flags  = GENL_ADMIN_PERM,
+    },
+};
+
+static struct genl_family ar_genl_family = {
+    .name           = AREG_GENL_NAME,
+    .version        = AREG_GENL_VERSION,
+    .maxattr        = AREG_A_MAX,
+    .policy         = ar_nl_policy,
+    .module         = THIS_MODULE,
+    .small_ops      = ar_nl_ops,
+    .n_small_ops    = ARRAY_SIZE(ar_nl_ops),
+    .resv_start_op  = AREG_CMD_EVENT + 1,
+    .mcgrps         = ar_nl_mcgrps,
+    .n_mcgrps       = ARRAY_SIZE(ar_nl_mcgrps),
+};
+
+/**************************************************************************
+ * Events
+ **************************************************************************/
+
+/* Called by the master once per iteration; cheap when nobody listens */
+void ar_nl_notify_cores(void)
+{
+    struct sk_buff *msg;
+    void *hdr;
+
+    if (!READ_ONCE(ar_nl_registered) ||
+        !genl_has_listeners(&ar_genl_family, &init_net, AR_NL_MCGRP_EVENTS))
+        return;
+
+    msg = genlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
+    if (!msg)
+        return;
+
+    hdr = genlmsg_put(msg, 0, 0, &ar_genl_family, 0, AREG_CMD_EVENT);
+    if (!hdr)
+        goto nla_put_failure;
+
+    if (nla_put_u64_64bit(msg, AREG_A_TIMESTAMP_NS, ktime_get_ns(), AREG_A_PAD) ||
+        ar_nl_put_cores(msg, false))
+        goto nla_put_failure;
+
+    genlmsg_end(msg, hdr);
+    genlmsg_multicast(&ar_genl_family, msg, 0, AR_NL_MCGRP_EVENTS, GFP_KERNEL);
+    return;
+
+nla_put_failure:
+    nlmsg_free(msg);
+}
+
+/**************************************************************************
+ * Init / Exit
+ **************************************************************************/
+
+int ar_nl_init(void)
+{
+    int ret = genl_register_family(&ar_genl_family);
+
+    if (ret) {
+        pr_err("%s: genl_register_family failed (%d)", __func__, ret);
+        return ret;
+    }
+
+    WRITE_ONCE(ar_nl_registered, true);
+    return 0;
+}
+
+/* The master is stopped first, so no event is being sent */
+void ar_nl_exit(void)
+{
+    if (!READ_ONCE(ar_nl_registered))
+        return;
+    WRITE_ONCE(ar_nl_registered, false);
+    genl_unregister_family(&ar_genl_family);
+}
@@ -0,0 +1,16 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#if !defined AR_NETLINK_H
+#define AR_NETLINK_H
+
+int ar_nl_init(void);
+void ar_nl_exit(void);
+void ar_nl_notify_cores(void);
+
+#endif /* AR_NETLINK_H */
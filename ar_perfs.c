@@ -3,8 +3,10 @@
  **************************************************************************/
 
 #include "kernel_headers.h"
+#include <linux/random.h>
 #include "ar.h"
 #include "ar_perfs.h"
+#include "utils.h"
 
 /**************************************************************************
  * Perf Structure definitions 
@@ -48,7 +50,52 @@ inline u64 perf_event_count(struct perf_event *event)
         atomic64_read(&event->child_count);
 }
 
-struct perf_event *init_counter(int cpu, int sample_period, int counter_id, void *callback)
+/** read the counter of a local, running event including the in-flight hardware delta. */
+u64 perf_event_read_now(struct perf_event *event)
+{
+    unsigned long flags;
+
+    local_irq_save(flags);
+    event->pmu->read(event);
+    local_irq_restore(flags);
+    return perf_event_count(event);
+}
+
+/**************************************************************************
+ * Counter backends
+ *
+ * The regulator sees a counter as a struct perf_event: it reads count,
+ * programs hw.period_left and calls pmu->stop/start/read, and the
+ * overflow_handler is called when period_left runs out. A backend only
+ * provides how such an event is created, enabled, paused and released.
+ *
+ *   perf    raw hardware PMU event through perf_event_create_kernel_counter
+ *   synth   software counter fed by a generator or a recorded trace and
+ *           driven by a pinned hrtimer; works in VMs and containers
+ *
+ * Selected at load time with counter_backend=perf|synth.
+ **************************************************************************/
+
+struct ar_counter_ops {
+    const char *name;
+    struct perf_event *(*create)(int cpu, int sample_period, int counter_id, void *callback);
+    void (*enable)(struct perf_event *event);
+    void (*pause)(struct perf_event *event);
+    void (*release)(struct perf_event *event);
+};
+
+static char *counter_backend = "perf";
+module_param(counter_backend, charp, S_IRUSR | S_IRGRP);
+MODULE_PARM_DESC(counter_backend, "perf (hardware PMU, default) or synth (simulated)");
+
+static const struct ar_counter_ops *ar_counter_get(void);
+
+/**************************************************************************
+ * perf backend
+ **************************************************************************/
+
+static struct perf_event *ar_perf_create(int cpu, int sample_period, int counter_id,
+                                         void *callback)
 {
     struct perf_event *event = NULL;
     struct perf_event_attr sched_perf_hw_attr = {
@@ -84,7 +131,356 @@ struct perf_event *init_counter(int cpu, int sample_period, int counter_id, void
         return NULL;
     }
 
-    pr_info("CPU%d configured counter 0x%x\n", cpu, counter_id);
+    return event;
+}
+
+static void ar_perf_release(struct perf_event *event)
+{
+    perf_event_disable(event);
+    perf_event_release_kernel(event);
+}
+
+static const struct ar_counter_ops ar_perf_ops = {
+    .name       = "perf",
+    .create     = ar_perf_create,
+    .enable     = perf_event_enable,
+    .pause      = perf_event_disable,
+    .release    = ar_perf_release,
+};
+
+/**************************************************************************
+ * synth backend
+ *
+ * Every synth_tick_us the tick of a core adds the events its workload
+ * would have caused in that time at the current rate (MB/s), and calls the
+ * overflow handler when period_left crosses zero, like a PMU interrupt
+ * would. The rate for synthetic millisecond t is
+ *   - synth_trace[t % len] once a trace is loaded, otherwise
+ *   - synth_base_mb, plus synth_burst_mb during the first
+ *     synth_burst_duty_pct of every synth_burst_period_ms,
+ * varied by up to +/- synth_jitter_pct. A throttled core generates no
+ * traffic, since its throttler kthread owns the CPU.
+ **************************************************************************/
+
+/* Largest trace accepted by ar/synth_trace: ~65 s at 1 ms per sample */
+#define AR_SYNTH_TRACE_MAX 65536
+
+struct ar_synth_trace {
+    u32 len;
+    u32 mb[];   /* MB/s per synthetic ms */
+};
+
+struct ar_synth_counter {
+    struct perf_event event;
+    struct hrtimer tick;
+    u64 elapsed_us;     /* synthetic time since the counter was created */
+    u64 rem;            /* sub-event remainder carried to the next tick */
+};
+
+static u32 ar_synth_base_mb = 500;
+static u32 ar_synth_burst_mb = 1500;
+static u32 ar_synth_burst_period_ms = 100;
+static u32 ar_synth_burst_duty_pct = 20;
+static u32 ar_synth_jitter_pct = 10;
+static u32 ar_synth_tick_us = 100;
+
+static struct ar_synth_trace __rcu *ar_synth_trace;
+static DEFINE_MUTEX(ar_synth_trace_lock);
+
+static u64 ar_synth_rate_mb(u64 t_ms)
+{
+    struct ar_synth_trace *trace;
+    u32 period, jitter;
+    u64 mb;
+
+    rcu_read_lock();
+    trace = rcu_dereference(ar_synth_trace);
+    if (trace) {
+        mb = trace->mb[do_div(t_ms, trace->len)];
+    } else {
+        mb = READ_ONCE(ar_synth_base_mb);
+        period = max_t(u32, READ_ONCE(ar_synth_burst_period_ms), 1);
+        if ((u64)do_div(t_ms, period) * 100 < (u64)period * READ_ONCE(ar_synth_burst_duty_pct))
+            mb += READ_ONCE(ar_synth_burst_mb);
+    }
+    rcu_read_unlock();
+
+    jitter = min_t(u32, READ_ONCE(ar_synth_jitter_pct), 100);
+    if (jitter && mb)
+        mb = div_u64(mb * (100 - jitter + get_random_u32_below(2 * jitter + 1)), 100);
+    return mb;
+}
+
+static enum hrtimer_restart ar_synth_tick(struct hrtimer *timer)
+{
+    struct ar_synth_counter *sc = container_of(timer, struct ar_synth_counter, tick);
+    struct perf_event *event = &sc->event;
+    u32 tick_us = max_t(u32, READ_ONCE(ar_synth_tick_us), 10);
+    u64 divisor = (u64)CACHE_LINE_SIZE * USEC_PER_SEC;
+    u64 mb = ar_synth_rate_mb(div_u64(sc->elapsed_us, USEC_PER_MSEC));
+    u64 delta;
+    s64 left;
+
+    sc->elapsed_us += tick_us;
+    hrtimer_forward_now(timer, us_to_ktime(tick_us));
+
+    if (event->hw.state & PERF_HES_STOPPED ||
+        atomic_read(&get_core_info(event->cpu)->throttler_task))
+        return HRTIMER_RESTART;
+
+    /* MB/s * us -> cache lines, keeping the remainder so slow rates add up */
+    delta = div64_u64_rem(mb * 1024 * 1024 * tick_us + sc->rem, divisor, &sc->rem);
+    if (!delta)
+        return HRTIMER_RESTART;
+
+    local64_add(delta, &event->count);
+    left = local64_sub_return(delta, &event->hw.period_left);
+    if (left <= 0) {
+        /* Re-arm like the PMU drivers do, then raise the "interrupt" */
+        left += event->hw.sample_period;
+        if (left <= 0)
+            left = event->hw.sample_period;
+        local64_set(&event->hw.period_left, left);
+        event->overflow_handler(event, NULL, get_irq_regs());
+    }
+    return HRTIMER_RESTART;
+}
+
+/*
+ * pmu callbacks used by the timer callback and the idle exit on the
+ * event's CPU. A stopped counter (e.g. a parked core) has no tick, which
+ * would otherwise end the idle period every synth_tick_us. Ticks missed
+ * while stopped still advance the synthetic time, and the tick keeps its
+ * phase across the stop/start of every interval.
+ */
+static void ar_synth_pmu_start(struct perf_event *event, int flags)
+{
+    struct ar_synth_counter *sc = container_of(event, struct ar_synth_counter, event);
+    u32 tick_us = max_t(u32, READ_ONCE(ar_synth_tick_us), 10);
+
+    event->hw.state = 0;
+    if (hrtimer_is_queued(&sc->tick))
+        return;
+
+    sc->elapsed_us += hrtimer_forward(&sc->tick, ktime_get(), us_to_ktime(tick_us)) * tick_us;
+    hrtimer_start_expires(&sc->tick, HRTIMER_MODE_ABS_PINNED);
+}
+
+static void ar_synth_pmu_stop(struct perf_event *event, int flags)
+{
+    struct ar_synth_counter *sc = container_of(event, struct ar_synth_counter, event);
+
+    event->hw.state |= PERF_HES_STOPPED;
+    /* On the tick's own CPU, so it is not running: this does not wait */
+    hrtimer_try_to_cancel(&sc->tick);
+}
+
+/* The count is current to the last tick */
+static void ar_synth_pmu_read(struct perf_event *event)
+{
+}
+
+static struct pmu ar_synth_pmu = {
+    .start      = ar_synth_pmu_start,
+    .stop       = ar_synth_pmu_stop,
+    .read       = ar_synth_pmu_read,
+};
+
+static struct perf_event *ar_synth_create(int cpu, int sample_period, int counter_id,
+                                          void *callback)
+{
+    struct ar_synth_counter *sc = kzalloc(sizeof(*sc), GFP_KERNEL);
+
+    if (!sc)
+        return NULL;
+
+    sc->event.cpu = cpu;
+    sc->event.pmu = &ar_synth_pmu;
+    sc->event.overflow_handler = callback;
+    sc->event.attr.config = counter_id;
+    sc->event.attr.sample_period = sample_period;
+    sc->event.hw.sample_period = sample_period;
+    sc->event.hw.state = PERF_HES_STOPPED;
+    local64_set(&sc->event.hw.period_left, sample_period);
+
+    hrtimer_init(&sc->tick, CLOCK_MONOTONIC, HRTIMER_MODE_REL_PINNED);
+    sc->tick.function = ar_synth_tick;
+    return &sc->event;
+}
+
+static void __ar_synth_start_on_cpu(void *info)
+{
+    struct ar_synth_counter *sc = info;
+
+    sc->event.hw.state = 0;
+    hrtimer_start(&sc->tick, us_to_ktime(max_t(u32, READ_ONCE(ar_synth_tick_us), 10)),
+                  HRTIMER_MODE_REL_PINNED);
+}
+
+static void ar_synth_enable(struct perf_event *event)
+{
+    struct ar_synth_counter *sc = container_of(event, struct ar_synth_counter, event);
+
+    /* A pinned hrtimer runs on the CPU that starts it */
+    smp_call_function_single(event->cpu, __ar_synth_start_on_cpu, sc, true);
+}
+
+static void ar_synth_pause(struct perf_event *event)
+{
+    struct ar_synth_counter *sc = container_of(event, struct ar_synth_counter, event);
+
+    hrtimer_cancel(&sc->tick);
+    event->hw.state |= PERF_HES_STOPPED;
+}
+
+static void ar_synth_release(struct perf_event *event)
+{
+    ar_synth_pause(event);
+    kfree(container_of(event, struct ar_synth_counter, event));
+}
+
+static const struct ar_counter_ops ar_synth_ops = {
+    .name       = "synth",
+    .create     = ar_synth_create,
+    .enable     = ar_synth_enable,
+    .pause      = ar_synth_pause,
+    .release    = ar_synth_release,
+};
+
+/* Show: one MB/s value per line. Write: whitespace separated MB/s values in
+ * a single write(2) replace the trace; an empty write drops it. */
+static int ar_synth_trace_show(struct seq_file *m, void *v)
+{
+    struct ar_synth_trace *trace;
+    u32 i;
+
+    mutex_lock(&ar_synth_trace_lock);
+    trace = rcu_dereference_protected(ar_synth_trace,
+                                      lockdep_is_held(&ar_synth_trace_lock));
+    if (trace)
+        for (i = 0; i < trace->len; i++)
+            seq_printf(m, "%u\n", trace->mb[i]);
+    mutex_unlock(&ar_synth_trace_lock);
+    return 0;
+}
+
+static int ar_synth_trace_open(struct inode *inode, struct file *filp)
+{
+    return single_open(filp, ar_synth_trace_show, NULL);
+}
+
+static ssize_t ar_synth_trace_write(struct file *filp, const char __user *ubuf,
+                                    size_t cnt, loff_t *ppos)
+{
+    struct ar_synth_trace *trace = NULL, *old;
+    char *buf, *pos, *tok;
+    u32 len = 0;
+    int ret = 0;
+
+    if (cnt > AR_SYNTH_TRACE_MAX * 12)
+        return -E2BIG;
+
+    buf = memdup_user_nul(ubuf, cnt);
+    if (IS_ERR(buf))
+        return PTR_ERR(buf);
+
+    trace = kvmalloc(struct_size(trace, mb, AR_SYNTH_TRACE_MAX), GFP_KERNEL);
+    if (!trace) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    pos = buf;
+    while ((tok = strsep(&pos, " \t\n,")) != NULL) {
+        if (!*tok)
+            continue;
+        if (len == AR_SYNTH_TRACE_MAX) {
+            ret = -E2BIG;
+            goto out;
+        }
+        ret = kstrtou32(tok, 0, &trace->mb[len]);
+        if (ret)
+            goto out;
+        len++;
+    }
+    trace->len = len;
+    if (!len) {
+        kvfree(trace);
+        trace = NULL;
+    }
+
+    mutex_lock(&ar_synth_trace_lock);
+    old = rcu_replace_pointer(ar_synth_trace, trace,
+                              lockdep_is_held(&ar_synth_trace_lock));
+    mutex_unlock(&ar_synth_trace_lock);
+    synchronize_rcu();
+    kvfree(old);
+    trace = NULL;
+    pr_info("synth trace: %u samples\n", len);
+
+out:
+    kvfree(trace);
+    kfree(buf);
+    return ret ? ret : cnt;
+}
+
+static const struct file_operations ar_synth_trace_fops = {
+    .open       = ar_synth_trace_open,
+    .write      = ar_synth_trace_write,
+    .read       = seq_read,
+    .llseek     = seq_lseek,
+    .release    = single_release,
+};
+
+/* Tick timers are gone by now (released with the counters) */
+void ar_perfs_exit(void)
+{
+    kvfree(rcu_dereference_protected(ar_synth_trace, true));
+    RCU_INIT_POINTER(ar_synth_trace, NULL);
+}
+
+void ar_perfs_init_debugfs(struct dentry *dir)
+{
+    if (ar_counter_get() != &ar_synth_ops)
+        return;
+
+    debugfs_create_u32("synth_base_mb", 0644, dir, &ar_synth_base_mb);
+    debugfs_create_u32("synth_burst_mb", 0644, dir, &ar_synth_burst_mb);
+    debugfs_create_u32("synth_burst_period_ms", 0644, dir, &ar_synth_burst_period_ms);
+    debugfs_create_u32("synth_burst_duty_pct", 0644, dir, &ar_synth_burst_duty_pct);
+    debugfs_create_u32("synth_jitter_pct", 0644, dir, &ar_synth_jitter_pct);
+    debugfs_create_u32("synth_tick_us", 0644, dir, &ar_synth_tick_us);
+    debugfs_create_file("synth_trace", 0644, dir, NULL, &ar_synth_trace_fops);
+}
+
+/**************************************************************************
+ * Counter API used by the regulator
+ **************************************************************************/
+
+static const struct ar_counter_ops *ar_counter_get(void)
+{
+    if (sysfs_streq(counter_backend, ar_synth_ops.name))
+        return &ar_synth_ops;
+    if (sysfs_streq(counter_backend, ar_perf_ops.name))
+        return &ar_perf_ops;
+    return NULL;
+}
+
+struct perf_event *init_counter(int cpu, int sample_period, int counter_id, void *callback)
+{
+    const struct ar_counter_ops *ops = ar_counter_get();
+    struct perf_event *event;
+
+    if (!ops) {
+        pr_err("unknown counter_backend %s\n", counter_backend);
+        return NULL;
+    }
+
+    event = ops->create(cpu, sample_period, counter_id, callback);
+    if (!event)
+        return NULL;
+
+    pr_info("CPU%d configured %s counter 0x%x\n", cpu, ops->name, counter_id);
     return event;
 }
 
@@ -99,13 +495,17 @@ void event_read_overflow_callback(struct perf_event *event,
 
 void enable_event(struct perf_event *event){
 
-	perf_event_enable(event);
+	ar_counter_get()->enable(event);
     pr_info("Perf event enabled (%llx)\n", event->attr.config);
 }
 
+/* Stop counting; enable_event() resumes */
+void pause_event(struct perf_event *event){
+    ar_counter_get()->pause(event);
+}
+
 void disable_event(struct perf_event *event){
-    perf_event_disable(event);
-    perf_event_release_kernel(event);
+    ar_counter_get()->release(event);
     pr_info("Perf event disabled (%llx)\n", event->attr.config);
 
 }
@@ -1,6 +1,18 @@
 #ifndef AR_PERFS_H
 #define AR_PERFS_H
 
+/**************************************************************************
+ * COUNTERS Format (Umask_code - EventCode) tools/perf/pmu-events/arch/x86/)
+ **************************************************************************/
+#if defined(__aarch64__) || defined(__arm__)
+#  define PMU_LLC_MISS_COUNTER_ID 0x17   // LINE_REFILL
+#  define PMU_LLC_WB_COUNTER_ID   0x18   // LINE_WB
+#elif defined(__x86_64__) || defined(__i386__)
+#  define PMU_LLC_MISS_COUNTER_ID 0x08b0 // OFFCORE_REQUESTS.ALL_DATA_RD
+#  define PMU_LLC_WB_COUNTER_ID   0x40b0 // OFFCORE_REQUESTS.WB
+#  define PMU_STALL_L3_MISS_CYCLES_COUNTER_ID   0x06A3 //CYCLE_ACTIVITY.STALLS_L3_MISS, 
+#endif
+
 
 struct perf_event *init_counter(int cpu, int sample_period, int counter_id, void *callback);
 
@@ -10,10 +22,19 @@ void event_read_overflow_callback(struct perf_event *event,
 
 inline u64 perf_event_count(struct perf_event *event);
 
+u64 perf_event_read_now(struct perf_event *event);
+
 inline void enable_event(struct perf_event *event);
 
 inline void disable_event(struct perf_event *event);
 
+void pause_event(struct perf_event *event);
+
+void ar_perfs_exit(void);
+
+struct dentry;
+void ar_perfs_init_debugfs(struct dentry *dir);
+
 void init_perf_workq(u8 cpuid);
 
 /* Getter setters for read event */
@@ -0,0 +1,219 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * "areg" software PMU exposing the regulator counters to perf, e.g.
+ *   perf stat -e areg/throttled_ns/,areg/overflows/ -C 1 -I 1000
+ *   perf stat -e areg/throttled_ns/,instructions,cycles -p <pid>
+ *
+ * Per-CPU events count the regulator activity of that core. Task events
+ * count the activity of the cores while the task ran on them; a throttle
+ * that preempts the task is charged to it when it is scheduled back in.
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+
+/**************************************************************************
+ * Included Files
+ **************************************************************************/
+#include "kernel_headers.h"
+#include "ar.h"
+#include "ar_pmu.h"
+
+/**************************************************************************
+ * Constants /Macros
+ **************************************************************************/
+
+/* hw.flags: task was switched out by the throttler on hw.idx */
+#define AR_PMU_F_PREEMPTED  0x1
+
+/**************************************************************************
+ * Counter access
+ **************************************************************************/
+
+static struct pmu ar_pmu;
+static bool ar_pmu_registered;
+
+static bool ar_pmu_regulated_cpu(int cpu)
+{
+    return cpu >= 1 && cpu <= MAX_NO_CPUS;
+}
+
+static u64 ar_pmu_value(int cpu, u64 config)
+{
+    if (!ar_pmu_regulated_cpu(cpu))
+        return 0;
+    return atomic64_read(&get_core_info(cpu)->pmu_count[config]);
+}
+
+/* Fold the counter delta since the last snapshot into the event */
+static void ar_pmu_update(struct perf_event *event)
+{
+    struct hw_perf_event *hwc = &event->hw;
+    u64 now = ar_pmu_value(hwc->idx, event->attr.config);
+    u64 prev = local64_xchg(&hwc->prev_count, now);
+
+    local64_add(now - prev, &event->count);
+}
+
+static void ar_pmu_snapshot(struct perf_event *event)
+{
+    struct hw_perf_event *hwc = &event->hw;
+
+    hwc->idx = (event->cpu >= 0) ? event->cpu : smp_processor_id();
+    local64_set(&hwc->prev_count, ar_pmu_value(hwc->idx, event->attr.config));
+}
+
+/**************************************************************************
+ * PMU callbacks
+ **************************************************************************/
+
+static int ar_pmu_event_init(struct perf_event *event)
+{
+    if (event->attr.type != ar_pmu.type)
+        return -ENOENT;
+
+    if (event->attr.config >= AR_PMU_NR_EVENTS)
+        return -EINVAL;
+
+    /* Counting only */
+    if (is_sampling_event(event) || has_branch_stack(event))
+        return -EOPNOTSUPP;
+
+    event->hw.flags = 0;
+    return 0;
+}
+
+static void ar_pmu_start(struct perf_event *event, int flags)
+{
+    struct hw_perf_event *hwc = &event->hw;
+
+    if (hwc->flags & AR_PMU_F_PREEMPTED) {
+        /* Charge the throttle that kicked the task off hw.idx */
+        ar_pmu_update(event);
+        hwc->flags &= ~AR_PMU_F_PREEMPTED;
+    }
+
+    ar_pmu_snapshot(event);
+    hwc->state = 0;
+}
+
+static void ar_pmu_stop(struct perf_event *event, int flags)
+{
+    struct hw_perf_event *hwc = &event->hw;
+    int cpu = smp_processor_id();
+
+    if (hwc->state & PERF_HES_STOPPED)
+        return;
+
+    /*
+     * A task switched out while its core is throttled is the victim of the
+     * throttle; defer the update so the spin is charged when it returns.
+     */
+    if (event->cpu < 0 && event->attr.config == AR_PMU_THROTTLED_NS &&
+        ar_pmu_regulated_cpu(cpu) &&
+        atomic_read(&get_core_info(cpu)->throttler_task))
+        hwc->flags |= AR_PMU_F_PREEMPTED;
+    else
+        ar_pmu_update(event);
+
+    hwc->state |= PERF_HES_STOPPED | PERF_HES_UPTODATE;
+}
+
+static int ar_pmu_add(struct perf_event *event, int flags)
+{
+    event->hw.state = PERF_HES_STOPPED | PERF_HES_UPTODATE;
+
+    if (flags & PERF_EF_START)
+        ar_pmu_start(event, flags);
+    return 0;
+}
+
+static void ar_pmu_del(struct perf_event *event, int flags)
+{
+    ar_pmu_stop(event, PERF_EF_UPDATE);
+}
+
+static void ar_pmu_read(struct perf_event *event)
+{
+    if (event->hw.flags & AR_PMU_F_PREEMPTED)
+        return;
+    ar_pmu_update(event);
+}
+
+/**************************************************************************
+ * sysfs: /sys/bus/event_source/devices/areg
+ **************************************************************************/
+
+PMU_FORMAT_ATTR(event, "config:0-7");
+
+static struct attribute *ar_pmu_format_attrs[] = {
+    &format_attr_event.attr,
+    NULL,
+};
+
+static const struct attribute_group ar_pmu_format_group = {
+    .name  = "format",
+    .attrs = ar_pmu_format_attrs,
+};
+
+PMU_EVENT_ATTR_STRING(throttled_ns, ar_pmu_throttled_ns, "event=0x00");
+PMU_EVENT_ATTR_STRING(overflows,    ar_pmu_overflows,    "event=0x01");
+PMU_EVENT_ATTR_STRING(budget_mb,    ar_pmu_budget_mb,    "event=0x02");
+PMU_EVENT_ATTR_STRING(predicted_mb, ar_pmu_predicted_mb, "event=0x03");
+PMU_EVENT_ATTR_STRING(intervals,    ar_pmu_intervals,    "event=0x04");
+
+static struct attribute *ar_pmu_event_attrs[] = {
+    &ar_pmu_throttled_ns.attr.attr,
+    &ar_pmu_overflows.attr.attr,
+    &ar_pmu_budget_mb.attr.attr,
+    &ar_pmu_predicted_mb.attr.attr,
+    &ar_pmu_intervals.attr.attr,
+    NULL,
+};
+
+static const struct attribute_group ar_pmu_events_group = {
+    .name  = "events",
+    .attrs = ar_pmu_event_attrs,
+};
+
+static const struct attribute_group *ar_pmu_attr_groups[] = {
+    &ar_pmu_format_group,
+    &ar_pmu_events_group,
+    NULL,
+};
+
+static struct pmu ar_pmu = {
+    .module         = THIS_MODULE,
+    .task_ctx_nr    = perf_sw_context,
+    .attr_groups    = ar_pmu_attr_groups,
+    .capabilities   = PERF_PMU_CAP_NO_INTERRUPT | PERF_PMU_CAP_NO_EXCLUDE,
+    .event_init     = ar_pmu_event_init,
+    .add            = ar_pmu_add,
+    .del            = ar_pmu_del,
+    .start          = ar_pmu_start,
+    .stop           = ar_pmu_stop,
+    .read           = ar_pmu_read,
+};
+
+int ar_pmu_init(void)
+{
+    int ret = perf_pmu_register(&ar_pmu, "areg", -1);
+
+    if (ret) {
+        pr_err("%s: perf_pmu_register failed (%d)", __func__, ret);
+        return ret;
+    }
+
+    ar_pmu_registered = true;
+    pr_info("%s: registered PMU areg (type %d)", __func__, ar_pmu.type);
+    return 0;
+}
+
+void ar_pmu_exit(void)
+{
+    if (ar_pmu_registered)
+        perf_pmu_unregister(&ar_pmu);
+    ar_pmu_registered = false;
+}
@@ -0,0 +1,29 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#if !defined AR_PMU_H
+#define AR_PMU_H
+
+/*
+ * Events of the "areg" software PMU (attr.config). All of them are
+ * monotonic per-core counters so that perf stat deltas are meaningful;
+ * average budgets per interval are budget_mb / intervals.
+ */
+enum ar_pmu_event {
+    AR_PMU_THROTTLED_NS = 0,  /* time the throttler held the core */
+    AR_PMU_OVERFLOWS,         /* budget overflows */
+    AR_PMU_BUDGET_MB,         /* sum of the budget (MB/s) of each interval */
+    AR_PMU_PREDICTED_MB,      /* sum of the prediction (MB/s) of each interval */
+    AR_PMU_INTERVALS,         /* regulation intervals */
+    AR_PMU_NR_EVENTS
+};
+
+int ar_pmu_init(void);
+void ar_pmu_exit(void);
+
+#endif /* AR_PMU_H */
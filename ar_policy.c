@@ -0,0 +1,353 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * Regulation policies decided by the master from the per-core predictions.
+ *
+ * Adaptive interval: while a core's prediction error stays within
+ * ar_adapt_tolerance_pct of its estimate for AR_ADAPT_STABLE_SAMPLES
+ * intervals, its interval is doubled (1 -> 2 -> 4 -> 8 x regulation time)
+ * up to ar_adapt_max_shift. An error spike or a budget overflow snaps it
+ * back to the regulation time.
+ *
+ * Token bucket: unused budget of an interval carries over to the next
+ * ones, up to ar_bucket_depth_pct of the per-interval budget, so short
+ * bursts straddling an interval boundary are not throttled while the
+ * long-run average stays capped at the budget.
+ *
+ * Contention gate: budgets are only enforced while the memory system is
+ * saturated. The summed consumption of the regulated cores closes the gate
+ * (regulate) at ar_gate_high_mb and opens it again once it has stayed
+ * below ar_gate_low_mb (0: 90% of high) for ar_gate_hold iterations; while
+ * open, cores run at their g_bw_max_mb and the counters keep sampling.
+ * With the latency probe enabled, ar_gate_high_lat_ns/ar_gate_low_lat_ns
+ * are a second, independent pair of marks on the loaded memory latency.
+ *
+ * Monitor only: predictions, budgets and overflows are computed and
+ * reported as usual but an overflow never throttles the core.
+ *
+ * Idle park: a core found idle by its regulation timer stops its counter
+ * and timer until it leaves idle, instead of waking up every interval.
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+
+/**************************************************************************
+ * Included Files
+ **************************************************************************/
+#include "kernel_headers.h"
+#include "ar.h"
+#include "ar_policy.h"
+#include "utils.h"
+#include "ar_debugfs.h"
+#include "ar_probe.h"
+
+/**************************************************************************
+ * Tunables (debugfs)
+ **************************************************************************/
+
+/* 0 keeps every core at the regulation time */
+static u8 ar_adapt_max_shift = 0;
+static u32 ar_adapt_tolerance_pct = 10;
+
+/* Carry unused budget over, up to depth_pct of one interval's budget */
+static bool ar_bucket_enabled = false;
+static u32 ar_bucket_depth_pct = 200;
+
+/* A high mark of 0 disables the gate: always regulate */
+static u64 ar_gate_high_mb = 0;
+static u64 ar_gate_low_mb = 0;
+static u32 ar_gate_hold = 100;
+static u64 ar_gate_high_lat_ns = 0;
+static u64 ar_gate_low_lat_ns = 0;
+
+/* Run the whole pipeline but never throttle */
+static bool ar_monitor_only_enabled = false;
+
+/* Suspend the timer and counter of idle regulated cores */
+static bool ar_idle_park_enabled = true;
+
+/* Arm the counter early by the learned overflow skid */
+static bool ar_skid_comp_enabled = true;
+
+#if defined(CONFIG_AR_TASK_WORK)
+/* Throttle user tasks in their return-to-user path, see ar_throttle_current() */
+static bool ar_task_work_enabled = false;
+#endif
+
+/**************************************************************************
+ * Adaptive interval
+ **************************************************************************/
+
+void ar_adapt_reset(struct ar_adapt *a)
+{
+    WRITE_ONCE(a->shift, 0);
+    a->stable = 0;
+    a->t_start = local_clock();
+    atomic_set(&a->overflowed, 0);
+}
+
+/* Master, core parked: its counter is stopped, so the time does not count */
+void ar_adapt_hold(struct ar_adapt *a, u64 now)
+{
+    a->t_start = now;
+}
+
+/*
+ * Called by the master once per iteration; true once the core's timer
+ * period, @base_ms (the regulation time) << shift, has passed since the
+ * last prediction. The master wakes once per jiffy, not once per interval.
+ */
+bool ar_adapt_due(struct ar_adapt *a, u32 base_ms, u64 now)
+{
+    return now - a->t_start >= (u64)ar_adapt_interval_ms(a, base_ms) * NSEC_PER_MSEC;
+}
+
+/* Time since the last prediction (ns, at least 1); restarts the span */
+u64 ar_adapt_span_ns(struct ar_adapt *a, u64 now)
+{
+    u64 span = max_t(u64, now - a->t_start, 1);
+
+    a->t_start = now;
+    return span;
+}
+
+/*
+ * Overflow irq_work: the budget was too small, go back to the shortest
+ * interval. Returns true if the core was on a longer one, whose timer the
+ * caller has to bring forward.
+ */
+bool ar_adapt_overflow(struct ar_adapt *a)
+{
+    u8 shift = READ_ONCE(a->shift);
+
+    WRITE_ONCE(a->shift, 0);
+    atomic_set(&a->overflowed, 1);
+    return shift != 0;
+}
+
+/* Master: grow or reset the interval from the error of the last prediction */
+void ar_adapt_update(struct ar_adapt *a, s64 error, s64 estimate)
+{
+    u8 max_shift = min_t(u8, READ_ONCE(ar_adapt_max_shift), AR_ADAPT_MAX_SHIFT);
+    u64 tolerance = div_u64((u64)max_t(s64, estimate, 1) *
+                            READ_ONCE(ar_adapt_tolerance_pct), 100);
+    u8 shift = READ_ONCE(a->shift);
+
+    if (atomic_xchg(&a->overflowed, 0) || abs(error) > tolerance) {
+        a->stable = 0;
+        WRITE_ONCE(a->shift, 0);
+        return;
+    }
+
+    if (shift > max_shift) {
+        WRITE_ONCE(a->shift, max_shift);
+        return;
+    }
+
+    if (++a->stable < AR_ADAPT_STABLE_SAMPLES || shift == max_shift)
+        return;
+
+    a->stable = 0;
+    WRITE_ONCE(a->shift, shift + 1);
+}
+
+/**************************************************************************
+ * Token bucket
+ **************************************************************************/
+
+/*
+ * Called when a new interval starts with @refill events of budget and the
+ * counter at @count_now. Returns the tokens available for the interval.
+ */
+u64 ar_bucket_refill(struct ar_bucket *b, u64 refill, u64 count_now)
+{
+    return ar_bucket_fill(b, refill, count_now,
+                          READ_ONCE(ar_bucket_enabled) ? READ_ONCE(ar_bucket_depth_pct) : 0);
+}
+
+static int ar_bucket_show(struct seq_file *m, void *v)
+{
+    u8 cpu_id;
+
+    seq_printf(m, "token bucket %s, depth %u%%\n",
+               READ_ONCE(ar_bucket_enabled) ? "on" : "off",
+               READ_ONCE(ar_bucket_depth_pct));
+    for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++) {
+        struct ar_bucket *b = &get_core_info(cpu_id)->bucket;
+
+        seq_printf(m, "CPU(%u) level=%llu refill=%llu (events)\n", cpu_id,
+                   READ_ONCE(b->level), READ_ONCE(b->refill));
+    }
+    return 0;
+}
+
+static int ar_bucket_open(struct inode *inode, struct file *filp)
+{
+    return single_open(filp, ar_bucket_show, NULL);
+}
+
+static const struct file_operations ar_bucket_fops = {
+    .open       = ar_bucket_open,
+    .read       = seq_read,
+    .llseek     = seq_lseek,
+    .release    = single_release,
+};
+
+/**************************************************************************
+ * Contention gate (master only, under ar_ctrl_lock())
+ **************************************************************************/
+
+extern u64 g_bw_max_mb[MAX_NO_CPUS+1];
+
+static struct ar_gate ar_gate = { .regulating = true };
+static u64 ar_gate_total_mb;
+static u64 ar_gate_lat_ns;
+
+/* Summed consumption of the regulated cores in the last iteration */
+static u64 ar_gate_demand(void)
+{
+    u64 total = 0;
+    u8 cpu_id;
+
+    for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++) {
+        struct core_info *cinfo = get_core_info(cpu_id);
+
+        if (!READ_ONCE(cinfo->parked))
+            total += cinfo->g_read_count_used;
+    }
+    return total;
+}
+
+static void ar_gate_read_marks(struct ar_gate_marks *m)
+{
+    m->high_mb = READ_ONCE(ar_gate_high_mb);
+    m->low_mb = READ_ONCE(ar_gate_low_mb);
+    m->high_lat_ns = READ_ONCE(ar_gate_high_lat_ns);
+    m->low_lat_ns = READ_ONCE(ar_gate_low_lat_ns);
+    m->hold = READ_ONCE(ar_gate_hold);
+}
+
+static bool ar_gate_update(u64 total_mb, u64 lat_ns)
+{
+    struct ar_gate_marks m;
+    u64 transitions = ar_gate.transitions;
+    bool regulating;
+
+    ar_gate_total_mb = total_mb;
+    ar_gate_lat_ns = lat_ns;
+
+    ar_gate_read_marks(&m);
+    regulating = ar_gate_step(&ar_gate, &m, total_mb, lat_ns);
+    if (ar_gate.transitions != transitions)
+        pr_debug("%s: %s at %llu MB/s", __func__,
+                 regulating ? "regulating" : "unregulated", total_mb);
+    return regulating;
+}
+
+/*
+ * Called by the master after the budgets of the iteration are set. Below
+ * the saturation mark every core gets its maximum bandwidth instead.
+ */
+void ar_gate_apply(void)
+{
+    u8 cpu_id;
+
+    if (ar_gate_update(ar_gate_demand(), ar_probe_latency_ns()))
+        return;
+
+    for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++) {
+        struct core_info *cinfo = get_core_info(cpu_id);
+        u64 max_mb = READ_ONCE(g_bw_max_mb[cpu_id]);
+
+        atomic64_set(&cinfo->budget_est, convert_mb_to_events(max_mb));
+        WRITE_ONCE(cinfo->budget_mb, max_mb);
+    }
+}
+
+static int ar_gate_show(struct seq_file *m, void *v)
+{
+    struct ar_gate_marks marks;
+
+    ar_gate_read_marks(&marks);
+    ar_ctrl_lock();
+    seq_printf(m, "%s total=%llu MB/s (high=%llu low=%llu) latency=%llu ns "
+               "(high=%llu low=%llu) hold=%u transitions=%llu\n",
+               !ar_gate_enabled(&marks) ? "off" :
+               ar_gate.regulating ? "regulating" : "unregulated",
+               ar_gate_total_mb, marks.high_mb, marks.low_mb, ar_gate_lat_ns,
+               marks.high_lat_ns, marks.low_lat_ns, marks.hold,
+               ar_gate.transitions);
+    ar_ctrl_unlock();
+    return 0;
+}
+
+static int ar_gate_open(struct inode *inode, struct file *filp)
+{
+    return single_open(filp, ar_gate_show, NULL);
+}
+
+static const struct file_operations ar_gate_fops = {
+    .open       = ar_gate_open,
+    .read       = seq_read,
+    .llseek     = seq_lseek,
+    .release    = single_release,
+};
+
+/**************************************************************************
+ * Idle cores
+ **************************************************************************/
+
+bool ar_idle_park(void)
+{
+    return READ_ONCE(ar_idle_park_enabled);
+}
+
+bool ar_monitor_only(void)
+{
+    return READ_ONCE(ar_monitor_only_enabled);
+}
+
+/**************************************************************************
+ * Skid compensation
+ **************************************************************************/
+
+bool ar_skid_compensation(void)
+{
+    return READ_ONCE(ar_skid_comp_enabled);
+}
+
+/**************************************************************************
+ * Enforcement path
+ **************************************************************************/
+
+bool ar_task_work_throttle(void)
+{
+#if defined(CONFIG_AR_TASK_WORK)
+    return READ_ONCE(ar_task_work_enabled);
+#else
+    return false;
+#endif
+}
+
+void ar_policy_init_debugfs(struct dentry *dir)
+{
+#if defined(CONFIG_AR_TASK_WORK)
+    debugfs_create_bool("task_work_throttle", 0644, dir, &ar_task_work_enabled);
+#endif
+    debugfs_create_bool("token_bucket", 0644, dir, &ar_bucket_enabled);
+    debugfs_create_u32("token_bucket_depth_pct", 0644, dir, &ar_bucket_depth_pct);
+    debugfs_create_file("bucket", 0444, dir, NULL, &ar_bucket_fops);
+    debugfs_create_u64("gate_high_mb", 0644, dir, &ar_gate_high_mb);
+    debugfs_create_u64("gate_low_mb", 0644, dir, &ar_gate_low_mb);
+    debugfs_create_u32("gate_hold", 0644, dir, &ar_gate_hold);
+    debugfs_create_u64("gate_high_lat_ns", 0644, dir, &ar_gate_high_lat_ns);
+    debugfs_create_u64("gate_low_lat_ns", 0644, dir, &ar_gate_low_lat_ns);
+    debugfs_create_file("gate", 0444, dir, NULL, &ar_gate_fops);
+    debugfs_create_bool("skid_compensation", 0644, dir, &ar_skid_comp_enabled);
+    debugfs_create_bool("idle_park", 0644, dir, &ar_idle_park_enabled);
+    debugfs_create_bool("monitor_only", 0644, dir, &ar_monitor_only_enabled);
+    debugfs_create_u8("adaptive_max_shift", 0644, dir, &ar_adapt_max_shift);
+    debugfs_create_u32("adaptive_tolerance_pct", 0644, dir, &ar_adapt_tolerance_pct);
+}
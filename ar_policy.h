@@ -0,0 +1,59 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#if !defined AR_POLICY_H
+#define AR_POLICY_H
+
+#include "ar_budget.h"
+
+/* Longest adaptive interval: regulation time << AR_ADAPT_MAX_SHIFT */
+#define AR_ADAPT_MAX_SHIFT 3
+
+/* Consecutive stable predictions before the interval is doubled */
+#define AR_ADAPT_STABLE_SAMPLES 4
+
+/*
+ * Per-core adaptive regulation interval. The core runs its timer every
+ * get_regulation_time() << shift ms with a budget scaled to match; the
+ * master only re-predicts once per such interval.
+ */
+struct ar_adapt {
+    /* Written by the master and the overflow irq_work, read by the timer */
+    u8 shift;
+
+    /* Master only; local_clock() of the last prediction */
+    u8 stable;
+    u64 t_start;
+
+    /* Set by the overflow irq_work, consumed by the master */
+    atomic_t overflowed;
+};
+
+struct dentry;
+
+void ar_adapt_reset(struct ar_adapt *a);
+void ar_adapt_hold(struct ar_adapt *a, u64 now);
+bool ar_adapt_due(struct ar_adapt *a, u32 base_ms, u64 now);
+u64 ar_adapt_span_ns(struct ar_adapt *a, u64 now);
+void ar_adapt_update(struct ar_adapt *a, s64 error, s64 estimate);
+bool ar_adapt_overflow(struct ar_adapt *a);
+u64 ar_bucket_refill(struct ar_bucket *b, u64 refill, u64 count_now);
+void ar_gate_apply(void);
+bool ar_idle_park(void);
+bool ar_monitor_only(void);
+bool ar_skid_compensation(void);
+bool ar_task_work_throttle(void);
+void ar_policy_init_debugfs(struct dentry *dir);
+
+/* Interval (ms) and budget multiplier of the core's current interval */
+static inline u32 ar_adapt_interval_ms(struct ar_adapt *a, u32 base_ms)
+{
+    return base_ms << READ_ONCE(a->shift);
+}
+
+#endif /* AR_POLICY_H */
@@ -0,0 +1,266 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * Loaded DRAM latency probe. The master on CPU0 periodically chases a
+ * random cyclic pointer chain over a buffer larger than the LLC; the mean
+ * time per hop is the memory latency the regulated cores currently see.
+ * No uncore PMU is needed, so this also works in VMs and on ARM boards.
+ *
+ * debugfs:
+ *   probe             1 allocates the buffer and starts probing, 0 frees it
+ *   probe_size_kb     buffer size used by the next enable
+ *   probe_period_ms   time between two probes
+ *   mem_latency       recent samples: timestamp_ns latency_ps
+ * and the areg:areg_mem_latency tracepoint for a full time series.
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+
+/**************************************************************************
+ * Included Files
+ **************************************************************************/
+#include "kernel_headers.h"
+#include <linux/random.h>
+#include "ar.h"
+#include "ar_probe.h"
+#include "ar_debugfs.h"
+#include "ar_trace.h"
+
+/**************************************************************************
+ * Constants /Macros
+ **************************************************************************/
+
+/* Hops per probe: ~100 us of chasing at DRAM latency */
+#define AR_PROBE_HOPS 1024
+
+/* Samples kept for debugfs ar/mem_latency */
+#define AR_PROBE_HIST 1024
+
+/**************************************************************************
+ * Globals (protected by ar_ctrl_lock())
+ **************************************************************************/
+
+struct ar_probe_node {
+    struct ar_probe_node *next;
+    u8 pad[L1_CACHE_BYTES - sizeof(void *)];
+};
+
+struct ar_probe_sample {
+    u64 timestamp_ns;
+    u64 latency_ps;
+};
+
+static struct ar_probe_node *ar_probe_buf;
+static struct ar_probe_node *ar_probe_pos;
+static u32 ar_probe_size_kb = 65536;
+static u32 ar_probe_period_ms = 10;
+static u64 ar_probe_last_ns;
+
+static struct ar_probe_sample ar_probe_hist[AR_PROBE_HIST];
+static u32 ar_probe_head;
+static u32 ar_probe_count;
+
+/* Mean latency of the last probe, for the policies */
+static u64 ar_probe_lat_ps;
+
+/**************************************************************************
+ * Probe
+ **************************************************************************/
+
+/*
+ * Link the nodes in a random order; the chain is one cycle over all of them.
+ * Tens of MB to fill, so it runs without ar_ctrl_lock() held.
+ */
+static struct ar_probe_node *ar_probe_alloc(void)
+{
+    size_t n = ((size_t)READ_ONCE(ar_probe_size_kb) * 1024) / sizeof(struct ar_probe_node);
+    struct ar_probe_node *buf;
+    u32 *perm;
+    size_t i;
+
+    if (n < 2 || n > U32_MAX)
+        return ERR_PTR(-EINVAL);
+
+    buf = vmalloc(array_size(n, sizeof(*buf)));
+    if (!buf)
+        return ERR_PTR(-ENOMEM);
+
+    perm = kvmalloc_array(n, sizeof(*perm), GFP_KERNEL);
+    if (!perm) {
+        vfree(buf);
+        return ERR_PTR(-ENOMEM);
+    }
+
+    for (i = 0; i < n; i++)
+        perm[i] = i;
+    for (i = n - 1; i > 0; i--) {
+        swap(perm[i], perm[get_random_u32_below(i + 1)]);
+        cond_resched();
+    }
+    for (i = 0; i < n; i++)
+        buf[perm[i]].next = &buf[perm[(i + 1) % n]];
+
+    kvfree(perm);
+    return buf;
+}
+
+/* Install @buf (NULL stops probing) under ar_ctrl_lock(); returns the old chain to vfree() */
+static struct ar_probe_node *ar_probe_swap(struct ar_probe_node *buf)
+{
+    struct ar_probe_node *old = ar_probe_buf;
+
+    WRITE_ONCE(ar_probe_buf, buf);
+    ar_probe_pos = buf;
+    ar_probe_count = 0;
+    ar_probe_head = 0;
+    WRITE_ONCE(ar_probe_lat_ps, 0);
+    return old;
+}
+
+/* Called by the master under ar_ctrl_lock() once per iteration */
+void ar_probe_run(void)
+{
+    struct ar_probe_node *p;
+    u64 now = ktime_get_ns();
+    u64 t0, ns;
+    int i;
+
+    if (!ar_probe_buf ||
+        now - ar_probe_last_ns < (u64)READ_ONCE(ar_probe_period_ms) * NSEC_PER_MSEC)
+        return;
+    ar_probe_last_ns = now;
+
+    p = ar_probe_pos;
+    preempt_disable();
+    t0 = local_clock();
+    for (i = 0; i < AR_PROBE_HOPS; i++)
+        p = READ_ONCE(p->next);
+    ns = local_clock() - t0;
+    preempt_enable();
+    ar_probe_pos = p;
+
+    WRITE_ONCE(ar_probe_lat_ps, div_u64(ns * 1000, AR_PROBE_HOPS));
+    trace_areg_mem_latency(ar_probe_lat_ps);
+
+    ar_probe_hist[ar_probe_head] = (struct ar_probe_sample) {
+        .timestamp_ns = now,
+        .latency_ps = ar_probe_lat_ps,
+    };
+    ar_probe_head = (ar_probe_head + 1) % AR_PROBE_HIST;
+    ar_probe_count = min(ar_probe_count + 1, (u32)AR_PROBE_HIST);
+}
+
+/* Loaded memory latency from the last probe; 0 when probing is off */
+u64 ar_probe_latency_ns(void)
+{
+    return div_u64(READ_ONCE(ar_probe_lat_ps), 1000);
+}
+
+void ar_probe_exit(void)
+{
+    struct ar_probe_node *old;
+
+    ar_ctrl_lock();
+    old = ar_probe_swap(NULL);
+    ar_ctrl_unlock();
+    vfree(old);
+}
+
+/**************************************************************************
+ * debugfs
+ **************************************************************************/
+
+static int ar_probe_enable_show(struct seq_file *m, void *v)
+{
+    seq_printf(m, "%u\n", READ_ONCE(ar_probe_buf) != NULL);
+    return 0;
+}
+
+static int ar_probe_enable_open(struct inode *inode, struct file *filp)
+{
+    return single_open(filp, ar_probe_enable_show, NULL);
+}
+
+static ssize_t ar_probe_enable_write(struct file *filp, const char __user *ubuf,
+                                     size_t cnt, loff_t *ppos)
+{
+    struct ar_probe_node *buf = NULL, *old;
+    bool enable;
+    int ret = kstrtobool_from_user(ubuf, cnt, &enable);
+
+    if (ret)
+        return ret;
+
+    if (enable) {
+        if (READ_ONCE(ar_probe_buf))
+            return cnt;
+        buf = ar_probe_alloc();
+        if (IS_ERR(buf)) {
+            pr_err("%s: probe buffer of %u KB not allocated (%ld)", __func__,
+                   ar_probe_size_kb, PTR_ERR(buf));
+            return PTR_ERR(buf);
+        }
+    }
+
+    ar_ctrl_lock();
+    /* A concurrent enable may have won; keep its chain */
+    old = (enable && ar_probe_buf) ? buf : ar_probe_swap(buf);
+    ar_ctrl_unlock();
+
+    vfree(old);
+    return cnt;
+}
+
+static const struct file_operations ar_probe_enable_fops = {
+    .open       = ar_probe_enable_open,
+    .write      = ar_probe_enable_write,
+    .read       = seq_read,
+    .llseek     = seq_lseek,
+    .release    = single_release,
+};
+
+static int ar_mem_latency_show(struct seq_file *m, void *v)
+{
+    struct ar_probe_sample *snap;
+    u32 i, count;
+
+    /* Copy under the lock, print without it: the master takes it every iteration */
+    snap = kvmalloc_array(AR_PROBE_HIST, sizeof(*snap), GFP_KERNEL);
+    if (!snap)
+        return -ENOMEM;
+
+    ar_ctrl_lock();
+    count = ar_probe_count;
+    for (i = 0; i < count; i++)
+        snap[i] = ar_probe_hist[(ar_probe_head + AR_PROBE_HIST - count + i) % AR_PROBE_HIST];
+    ar_ctrl_unlock();
+
+    seq_puts(m, "# timestamp_ns latency_ps\n");
+    for (i = 0; i < count; i++)
+        seq_printf(m, "%llu %llu\n", snap[i].timestamp_ns, snap[i].latency_ps);
+
+    kvfree(snap);
+    return 0;
+}
+
+static int ar_mem_latency_open(struct inode *inode, struct file *filp)
+{
+    return single_open(filp, ar_mem_latency_show, NULL);
+}
+
+static const struct file_operations ar_mem_latency_fops = {
+    .open       = ar_mem_latency_open,
+    .read       = seq_read,
+    .llseek     = seq_lseek,
+    .release    = single_release,
+};
+
+void ar_probe_init_debugfs(struct dentry *dir)
+{
+    debugfs_create_file("probe", 0644, dir, NULL, &ar_probe_enable_fops);
+    debugfs_create_u32("probe_size_kb", 0644, dir, &ar_probe_size_kb);
+    debugfs_create_u32("probe_period_ms", 0644, dir, &ar_probe_period_ms);
+    debugfs_create_file("mem_latency", 0444, dir, NULL, &ar_mem_latency_fops);
+}
@@ -0,0 +1,19 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#if !defined AR_PROBE_H
+#define AR_PROBE_H
+
+struct dentry;
+
+void ar_probe_run(void);
+u64 ar_probe_latency_ns(void);
+void ar_probe_exit(void);
+void ar_probe_init_debugfs(struct dentry *dir);
+
+#endif /* AR_PROBE_H */
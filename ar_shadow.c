@@ -0,0 +1,174 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * Shadow-mode evaluation. Every time the master re-predicts a core, the
+ * shadow slot of the core runs ar_shadow_predictor with its own LMS weights
+ * on the same history, applies ar_shadow_headroom_pct as its budget policy
+ * and scores both sides on the usage that followed: prediction error,
+ * budget granted and whether the budget would have overflowed.
+ *
+ * debugfs:
+ *   shadow                 1 enables the shadow slots
+ *   shadow_predictor       enum areg_predictor of the shadow
+ *   shadow_headroom_pct    shadow budget = estimate * (100 + pct) / 100
+ *   shadow_stats           live vs shadow per core; any write resets
+ *
+ * Together with ar/monitor_only (no throttling, see ar_policy.c) a
+ * candidate can be compared against the live pipeline on real traffic.
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+
+/**************************************************************************
+ * Included Files
+ **************************************************************************/
+#include "kernel_headers.h"
+#include "ar.h"
+#include "ar_shadow.h"
+#include "ar_debugfs.h"
+#include "ar_uapi.h"
+#include "model.h"
+
+/**************************************************************************
+ * Tunables (debugfs)
+ **************************************************************************/
+static bool ar_shadow_enabled = false;
+static u8 ar_shadow_predictor = AREG_PRED_HIST_MAX;
+static u32 ar_shadow_headroom_pct = 0;
+
+extern u64 g_bw_intial_setpoint_mb[MAX_NO_CPUS+1];
+
+/**************************************************************************
+ * Shadow slot
+ **************************************************************************/
+
+static void ar_shadow_clear_scores(struct ar_shadow *sh)
+{
+    memset(&sh->live, 0, sizeof(sh->live));
+    memset(&sh->shadow, 0, sizeof(sh->shadow));
+}
+
+void ar_shadow_reset(struct core_info *cinfo)
+{
+    struct ar_shadow *sh = &cinfo->shadow;
+
+    initialize_weights(sh->weights, true);
+    sh->prev_estimate = 0;
+    sh->budget_mb = 0;
+    ar_shadow_clear_scores(sh);
+}
+
+static void ar_shadow_score(struct ar_shadow_side *side, u64 used, s64 estimate,
+                            u64 budget_mb)
+{
+    side->n++;
+    side->sum_abs_err += abs((s64)used - estimate);
+    side->sum_budget += budget_mb;
+    if (used > budget_mb)
+        side->overflows++;
+}
+
+/*
+ * Called by the master after the live prediction of @cinfo, with the live
+ * budget that was in force while g_read_count_used was consumed.
+ */
+void ar_shadow_step(struct core_info *cinfo, u64 live_budget_mb)
+{
+    struct ar_shadow *sh = &cinfo->shadow;
+    u64 used = cinfo->g_read_count_used;
+    u8 predictor = READ_ONCE(ar_shadow_predictor);
+    s64 estimate, error;
+
+    if (!READ_ONCE(ar_shadow_enabled))
+        return;
+
+    /* Score the interval that just ended; budgets are 0 before the first one */
+    if (sh->budget_mb) {
+        ar_shadow_score(&sh->live, used, cinfo->prev_estimate, live_budget_mb);
+        ar_shadow_score(&sh->shadow, used, sh->prev_estimate, sh->budget_mb);
+    }
+
+    if (predictor >= AREG_NR_PREDICTORS)
+        predictor = AREG_PRED_LMS;
+
+    /* Same order as the live model_step(): predict, then learn */
+    estimate = model_step_wm(cinfo, predictor, sh->weights, used, sh->prev_estimate,
+                             READ_ONCE(g_bw_intial_setpoint_mb[cinfo->cpu_id]),
+                             &error);
+    if (estimate < 0)
+        estimate = 0;
+
+    sh->prev_estimate = estimate;
+    sh->budget_mb = max_t(u64, div_u64((u64)estimate *
+                                       (100 + READ_ONCE(ar_shadow_headroom_pct)), 100), 1);
+}
+
+/**************************************************************************
+ * debugfs
+ **************************************************************************/
+
+static void ar_shadow_side_show(struct seq_file *m, const char *name,
+                                struct ar_shadow_side *side)
+{
+    u64 n = max_t(u64, side->n, 1);
+
+    seq_printf(m, "  %-6s n=%llu mean_abs_err=%llu mean_budget=%llu overflows=%llu\n",
+               name, side->n, div64_u64(side->sum_abs_err, n),
+               div64_u64(side->sum_budget, n), side->overflows);
+}
+
+static int ar_shadow_show(struct seq_file *m, void *v)
+{
+    u8 cpu_id;
+
+    seq_printf(m, "shadow %s predictor=%u headroom=%u%%\n",
+               READ_ONCE(ar_shadow_enabled) ? "on" : "off",
+               READ_ONCE(ar_shadow_predictor), READ_ONCE(ar_shadow_headroom_pct));
+    ar_ctrl_lock();
+    for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++) {
+        struct ar_shadow *sh = &get_core_info(cpu_id)->shadow;
+
+        seq_printf(m, "CPU(%u) (MB/s)\n", cpu_id);
+        ar_shadow_side_show(m, "live", &sh->live);
+        ar_shadow_side_show(m, "shadow", &sh->shadow);
+    }
+    ar_ctrl_unlock();
+    return 0;
+}
+
+static int ar_shadow_open(struct inode *inode, struct file *filp)
+{
+    return single_open(filp, ar_shadow_show, NULL);
+}
+
+/* Any write resets the scores of all cores */
+static ssize_t ar_shadow_write(struct file *filp, const char __user *ubuf,
+                               size_t cnt, loff_t *ppos)
+{
+    u8 cpu_id;
+
+    ar_ctrl_lock();
+    for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++)
+        ar_shadow_clear_scores(&get_core_info(cpu_id)->shadow);
+    ar_ctrl_unlock();
+
+    return cnt;
+}
+
+static const struct file_operations ar_shadow_fops = {
+    .open       = ar_shadow_open,
+    .write      = ar_shadow_write,
+    .read       = seq_read,
+    .llseek     = seq_lseek,
+    .release    = single_release,
+};
+
+void ar_shadow_init_debugfs(struct dentry *dir)
+{
+    debugfs_create_bool("shadow", 0644, dir, &ar_shadow_enabled);
+    debugfs_create_u8("shadow_predictor", 0644, dir, &ar_shadow_predictor);
+    debugfs_create_u32("shadow_headroom_pct", 0644, dir, &ar_shadow_headroom_pct);
+    debugfs_create_file("shadow_stats", 0644, dir, NULL, &ar_shadow_fops);
+}
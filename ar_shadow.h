@@ -0,0 +1,41 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#if !defined AR_SHADOW_H
+#define AR_SHADOW_H
+
+/* What one side (live or shadow) would have done over the compared intervals */
+struct ar_shadow_side {
+    u64 n;
+    u64 sum_abs_err;    /* MB/s */
+    u64 sum_budget;     /* MB/s */
+    u64 overflows;      /* intervals whose usage exceeded the budget */
+};
+
+/*
+ * Per-core shadow slot: a second predictor and budget policy fed with the
+ * same history as the live one. It never touches budget_est. Master only,
+ * under ar_ctrl_lock().
+ */
+struct ar_shadow {
+    double weights[HIST_SIZE];
+    s64 prev_estimate;
+    u64 budget_mb;
+
+    struct ar_shadow_side live;
+    struct ar_shadow_side shadow;
+};
+
+struct core_info;
+struct dentry;
+
+void ar_shadow_reset(struct core_info *cinfo);
+void ar_shadow_step(struct core_info *cinfo, u64 live_budget_mb);
+void ar_shadow_init_debugfs(struct dentry *dir);
+
+#endif /* AR_SHADOW_H */
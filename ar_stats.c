@@ -0,0 +1,511 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * Per-core statistics of the regulator, exported through debugfs.
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+
+/**************************************************************************
+ * Included Files
+ **************************************************************************/
+#include "kernel_headers.h"
+#include "ar.h"
+#include "ar_stats.h"
+#include "ar_debugfs.h"
+#include "ar_uapi.h"
+#include "ar_policy.h"
+#include <linux/int_sqrt.h>
+
+/**************************************************************************
+ * Histogram helpers
+ **************************************************************************/
+
+void ar_log2_hist_add(struct ar_log2_hist *h, u64 value)
+{
+    u8 b = (value == 0) ? 0 : fls64(value) - 1;
+
+    if (b >= AR_LOG2_BUCKETS)
+        b = AR_LOG2_BUCKETS - 1;
+
+    h->bucket[b]++;
+    h->count++;
+    h->sum += value;
+    if (value > h->max)
+        h->max = value;
+}
+
+static void ar_log2_hist_show(struct seq_file *m, const char *name,
+                              const struct ar_log2_hist *h)
+{
+    u8 b;
+
+    seq_printf(m, "  %-18s count=%llu avg=%llu max=%llu\n", name, h->count,
+               h->count ? div64_u64(h->sum, h->count) : 0, h->max);
+
+    for (b = 0; b < AR_LOG2_BUCKETS; b++) {
+        if (h->bucket[b] == 0)
+            continue;
+        seq_printf(m, "    [%llu, %llu) %llu\n",
+                   b ? 1ULL << b : 0, 1ULL << (b + 1), h->bucket[b]);
+    }
+}
+
+/**************************************************************************
+ * Overflow skid
+ **************************************************************************/
+
+void ar_skid_reset(struct core_info *cinfo)
+{
+    ewma_ar_skid_init(&cinfo->skid.overshoot);
+    cinfo->skid.nr_samples = 0;
+    cinfo->skid.last = 0;
+}
+
+/*
+ * Called by the timer when it loads the budget of a new interval. Returns
+ * the period to arm: @budget less the overshoot the core usually has
+ * between the overflow and the throttler spinning.
+ */
+u64 ar_skid_arm(struct core_info *cinfo, u64 budget, u64 count_now)
+{
+    struct ar_skid *skid = &cinfo->skid;
+    u64 comp = 0;
+
+    if (ar_skid_compensation())
+        comp = min_t(u64, ewma_ar_skid_read(&skid->overshoot),
+                     div_u64(budget * AR_SKID_MAX_PCT, 100));
+
+    skid->count_at_start = count_now;
+    skid->budget = budget;
+    skid->armed = max_t(u64, budget - comp, 1);
+    return skid->armed;
+}
+
+/* Throttler: events counted past the armed period when the spin starts */
+static void ar_skid_learn(struct core_info *cinfo, u64 count_at_spin)
+{
+    struct ar_skid *skid = &cinfo->skid;
+    u64 used = count_at_spin - skid->count_at_start;
+
+    /* The timer may have started a new interval in between */
+    if (count_at_spin < skid->count_at_start || used < skid->armed ||
+        used - skid->armed > skid->budget)
+        return;
+
+    skid->last = used - skid->armed;
+    ewma_ar_skid_add(&skid->overshoot, skid->last);
+    skid->nr_samples++;
+}
+
+static int ar_skid_show(struct seq_file *m, void *v)
+{
+    u8 cpu_id;
+
+    seq_printf(m, "compensation %s\n", ar_skid_compensation() ? "on" : "off");
+    for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++) {
+        struct ar_skid *skid = &get_core_info(cpu_id)->skid;
+
+        seq_printf(m, "CPU(%u) overshoot_avg=%lu last=%llu samples=%llu "
+                   "budget=%llu armed=%llu (events)\n", cpu_id,
+                   ewma_ar_skid_read(&skid->overshoot), READ_ONCE(skid->last),
+                   READ_ONCE(skid->nr_samples), READ_ONCE(skid->budget),
+                   READ_ONCE(skid->armed));
+    }
+    return 0;
+}
+
+static int ar_skid_open(struct inode *inode, struct file *filp)
+{
+    return single_open(filp, ar_skid_show, NULL);
+}
+
+static const struct file_operations ar_skid_fops = {
+    .open       = ar_skid_open,
+    .read       = seq_read,
+    .llseek     = seq_lseek,
+    .release    = single_release,
+};
+
+/**************************************************************************
+ * Overflow to throttle latency
+ **************************************************************************/
+
+/*
+ * Called by the throttler on its own core once it has been scheduled in,
+ * before it starts spinning. The histograms are written from here and
+ * cleared from debugfs, both under lat->lock.
+ */
+void ar_latency_record_spin(struct core_info *cinfo, u64 t_spin, u64 count_at_spin)
+{
+    struct ar_latency *lat = &cinfo->lat;
+
+    /* Throttle without a preceding overflow (e.g. master initiated) */
+    if (lat->t_overflow == 0)
+        return;
+
+    spin_lock(&lat->lock);
+
+    ar_log2_hist_add(&lat->hop[AR_HOP_OVERFLOW_TO_IRQ_WORK],
+                     lat->t_irq_work - lat->t_overflow);
+    ar_log2_hist_add(&lat->hop[AR_HOP_IRQ_WORK_TO_WAKEUP],
+                     lat->t_wakeup - lat->t_irq_work);
+    ar_log2_hist_add(&lat->hop[AR_HOP_WAKEUP_TO_SPIN],
+                     t_spin - lat->t_wakeup);
+    ar_log2_hist_add(&lat->hop[AR_HOP_OVERFLOW_TO_SPIN],
+                     t_spin - lat->t_overflow);
+
+    ar_log2_hist_add(&lat->overshoot,
+                     (count_at_spin > lat->count_at_overflow) ?
+                     count_at_spin - lat->count_at_overflow : 0);
+    spin_unlock(&lat->lock);
+
+    ar_skid_learn(cinfo, count_at_spin);
+
+    lat->t_overflow = 0;
+}
+
+static const char *ar_hop_names[AR_NR_HOPS] = {
+    [AR_HOP_OVERFLOW_TO_IRQ_WORK] = "overflow->irq_work",
+    [AR_HOP_IRQ_WORK_TO_WAKEUP]   = "irq_work->wakeup",
+    [AR_HOP_WAKEUP_TO_SPIN]       = "wakeup->spin",
+    [AR_HOP_OVERFLOW_TO_SPIN]     = "overflow->spin",
+};
+
+static int ar_latency_show(struct seq_file *m, void *v)
+{
+    u8 cpu_id;
+    u8 hop;
+
+    for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++) {
+        struct core_info *cinfo = get_core_info(cpu_id);
+
+        spin_lock(&cinfo->lat.lock);
+        seq_printf(m, "CPU(%u) latency (ns)\n", cpu_id);
+        for (hop = 0; hop < AR_NR_HOPS; hop++)
+            ar_log2_hist_show(m, ar_hop_names[hop], &cinfo->lat.hop[hop]);
+
+        seq_printf(m, "CPU(%u) overshoot (events)\n", cpu_id);
+        ar_log2_hist_show(m, "overflow->spin", &cinfo->lat.overshoot);
+        spin_unlock(&cinfo->lat.lock);
+    }
+    return 0;
+}
+
+static int ar_latency_open(struct inode *inode, struct file *filp)
+{
+    return single_open(filp, ar_latency_show, NULL);
+}
+
+/* Any write resets the histograms of all cores */
+static ssize_t ar_latency_write(struct file *filp, const char __user *ubuf,
+                                size_t cnt, loff_t *ppos)
+{
+    u8 cpu_id;
+
+    for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++) {
+        struct ar_latency *lat = &get_core_info(cpu_id)->lat;
+
+        spin_lock(&lat->lock);
+        memset(lat->hop, 0, sizeof(lat->hop));
+        memset(&lat->overshoot, 0, sizeof(lat->overshoot));
+        spin_unlock(&lat->lock);
+    }
+
+    return cnt;
+}
+
+static const struct file_operations ar_latency_fops = {
+    .open       = ar_latency_open,
+    .write      = ar_latency_write,
+    .read       = seq_read,
+    .llseek     = seq_lseek,
+    .release    = single_release,
+};
+
+/**************************************************************************
+ * Regulator self-overhead
+ **************************************************************************/
+
+void ar_overhead_add(struct core_info *cinfo, enum ar_ovh_path path, u64 ns)
+{
+    cinfo->ovh.ns[path] += ns;
+    cinfo->ovh.calls[path]++;
+}
+
+static u64 ar_throttler_ctxsw(struct core_info *cinfo)
+{
+    struct task_struct *t = cinfo->throttler_thread;
+
+    return t ? t->nvcsw + t->nivcsw : 0;
+}
+
+void ar_overhead_reset(struct core_info *cinfo)
+{
+    memset(cinfo->ovh.ns, 0, sizeof(cinfo->ovh.ns));
+    memset(cinfo->ovh.calls, 0, sizeof(cinfo->ovh.calls));
+    cinfo->ovh.ctxsw_reset = ar_throttler_ctxsw(cinfo);
+    cinfo->ovh.t_reset = local_clock();
+}
+
+static const char *ar_ovh_names[AR_NR_OVH_PATHS] = {
+    [AR_OVH_TIMER]     = "timer",
+    [AR_OVH_MASTER]    = "master",
+    [AR_OVH_THROTTLER] = "throttler",
+};
+
+static int ar_overhead_show(struct seq_file *m, void *v)
+{
+    u64 now = local_clock();
+    u8 cpu_id;
+    u8 path;
+
+    seq_printf(m, "%-6s %-9s %12s %16s %10s\n",
+               "cpu", "path", "calls", "ns", "avg_ns");
+
+    for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++) {
+        struct core_info *cinfo = get_core_info(cpu_id);
+        struct ar_overhead *ovh = &cinfo->ovh;
+        u64 elapsed = now - ovh->t_reset;
+        u64 total = 0;
+        u64 pct_milli;
+
+        for (path = 0; path < AR_NR_OVH_PATHS; path++) {
+            seq_printf(m, "CPU(%u) %-9s %12llu %16llu %10llu\n", cpu_id,
+                       ar_ovh_names[path], ovh->calls[path], ovh->ns[path],
+                       ovh->calls[path] ?
+                       div64_u64(ovh->ns[path], ovh->calls[path]) : 0);
+            total += ovh->ns[path];
+        }
+
+        /* Share of wall time spent in the regulator, in units of 0.001% */
+        pct_milli = elapsed ? div64_u64(total * 100000, elapsed) : 0;
+        seq_printf(m, "CPU(%u) ctxsw=%llu interval_ms=%u overhead=%llu.%03llu%%\n",
+                   cpu_id, ar_throttler_ctxsw(cinfo) - ovh->ctxsw_reset,
+                   get_regulation_time(), pct_milli / 1000, pct_milli % 1000);
+    }
+    return 0;
+}
+
+static int ar_overhead_open(struct inode *inode, struct file *filp)
+{
+    return single_open(filp, ar_overhead_show, NULL);
+}
+
+/* Any write resets the counters of all cores */
+static ssize_t ar_overhead_write(struct file *filp, const char __user *ubuf,
+                                 size_t cnt, loff_t *ppos)
+{
+    u8 cpu_id;
+
+    for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++)
+        ar_overhead_reset(get_core_info(cpu_id));
+
+    return cnt;
+}
+
+static const struct file_operations ar_overhead_fops = {
+    .open       = ar_overhead_open,
+    .write      = ar_overhead_write,
+    .read       = seq_read,
+    .llseek     = seq_lseek,
+    .release    = single_release,
+};
+
+/**************************************************************************
+ * Prediction accuracy
+ **************************************************************************/
+
+static void ar_acc_window_add(struct ar_acc_window *w, s64 error)
+{
+    u64 abs_err = (error < 0) ? -error : error;
+
+    w->n++;
+    w->sum_abs += abs_err;
+    w->sum_sq += abs_err * abs_err;
+    w->sum_err += error;
+}
+
+/* Start all windows over from the current counts; under acc->lock */
+static void ar_accuracy_clear(struct ar_accuracy *acc)
+{
+    memset(&acc->life, 0, sizeof(acc->life));
+    memset(&acc->cur, 0, sizeof(acc->cur));
+    memset(&acc->last, 0, sizeof(acc->last));
+    acc->life_over_base = acc->cur_over_base = READ_ONCE(acc->nr_over);
+    acc->life_under_base = acc->cur_under_base = READ_ONCE(acc->nr_under);
+}
+
+/* Called by the master each time a prediction of @cinfo is scored */
+void ar_accuracy_record(struct core_info *cinfo, s64 error)
+{
+    struct ar_accuracy *acc = &cinfo->acc;
+    u64 nr_over = READ_ONCE(acc->nr_over);
+    u64 nr_under = READ_ONCE(acc->nr_under);
+
+    spin_lock(&acc->lock);
+    ar_acc_window_add(&acc->life, error);
+    ar_acc_window_add(&acc->cur, error);
+
+    acc->life.over = nr_over - acc->life_over_base;
+    acc->life.under = nr_under - acc->life_under_base;
+    acc->cur.over = nr_over - acc->cur_over_base;
+    acc->cur.under = nr_under - acc->cur_under_base;
+
+    if (acc->cur.n >= AR_ACC_WINDOW) {
+        acc->last = acc->cur;
+        memset(&acc->cur, 0, sizeof(acc->cur));
+        acc->cur_over_base = nr_over;
+        acc->cur_under_base = nr_under;
+    }
+    spin_unlock(&acc->lock);
+}
+
+static void ar_acc_window_show(struct seq_file *m, u8 cpu_id, const char *name,
+                               const struct ar_acc_window *w)
+{
+    u64 mae = w->n ? div64_u64(w->sum_abs, w->n) : 0;
+    u64 rmse = w->n ? int_sqrt64(div64_u64(w->sum_sq, w->n)) : 0;
+    s64 bias = w->n ? div64_s64(w->sum_err, w->n) : 0;
+
+    seq_printf(m, "CPU(%u) %-8s %10llu %8llu %8llu %8lld %10llu %10llu\n",
+               cpu_id, name, w->n, mae, rmse, bias, w->over, w->under);
+}
+
+static int ar_accuracy_show(struct seq_file *m, void *v)
+{
+    u8 cpu_id;
+
+    seq_printf(m, "# error = used - predicted (MB/s); window = %u intervals\n",
+               AR_ACC_WINDOW);
+    seq_printf(m, "%-6s %-8s %10s %8s %8s %8s %10s %10s\n", "cpu", "view",
+               "n", "mae", "rmse", "bias", "over_prov", "under_prov");
+
+    for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++) {
+        struct ar_accuracy *acc = &get_core_info(cpu_id)->acc;
+
+        spin_lock(&acc->lock);
+        ar_acc_window_show(m, cpu_id, "window", &acc->last);
+        ar_acc_window_show(m, cpu_id, "current", &acc->cur);
+        ar_acc_window_show(m, cpu_id, "lifetime", &acc->life);
+        spin_unlock(&acc->lock);
+    }
+    return 0;
+}
+
+static int ar_accuracy_open(struct inode *inode, struct file *filp)
+{
+    return single_open(filp, ar_accuracy_show, NULL);
+}
+
+/* Any write resets the metrics of all cores */
+static ssize_t ar_accuracy_write(struct file *filp, const char __user *ubuf,
+                                 size_t cnt, loff_t *ppos)
+{
+    u8 cpu_id;
+
+    for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++) {
+        struct ar_accuracy *acc = &get_core_info(cpu_id)->acc;
+
+        spin_lock(&acc->lock);
+        ar_accuracy_clear(acc);
+        spin_unlock(&acc->lock);
+    }
+
+    return cnt;
+}
+
+static const struct file_operations ar_accuracy_fops = {
+    .open       = ar_accuracy_open,
+    .write      = ar_accuracy_write,
+    .read       = seq_read,
+    .llseek     = seq_lseek,
+    .release    = single_release,
+};
+
+/**************************************************************************
+ * Per-interval samples
+ **************************************************************************/
+
+/* ~2 s of history for 4 cores at the master's 1 ms cadence */
+#define AR_SAMPLES_FIFO_SIZE 8192
+
+/* Single producer (master) and single consumer (reader, under mutex) */
+static DEFINE_KFIFO(ar_samples_fifo, struct areg_sample, AR_SAMPLES_FIFO_SIZE);
+static DECLARE_WAIT_QUEUE_HEAD(ar_samples_wq);
+static DEFINE_MUTEX(ar_samples_read_mutex);
+static u64 ar_samples_dropped;
+
+/* Called by the master after it has updated @cinfo for the interval */
+void ar_samples_push(struct core_info *cinfo)
+{
+    struct areg_sample sample = {
+        .timestamp_ns = ktime_get_ns(),
+        .used_mb      = cinfo->g_read_count_used,
+        .predicted_mb = cinfo->next_estimate,
+        .budget_mb    = READ_ONCE(cinfo->budget_mb),
+        .overflows    = atomic64_read(&cinfo->pmu_count[AR_PMU_OVERFLOWS]),
+        .throttled_ns = atomic64_read(&cinfo->pmu_count[AR_PMU_THROTTLED_NS]),
+        .cpu          = cinfo->cpu_id,
+        .flags        = atomic_read(&cinfo->throttler_task) ?
+                        AREG_SAMPLE_F_THROTTLED : 0,
+    };
+
+    if (!kfifo_put(&ar_samples_fifo, sample))
+        ar_samples_dropped++;
+}
+
+/* Called by the master once per iteration after pushing all cores */
+void ar_samples_wake(void)
+{
+    if (!kfifo_is_empty(&ar_samples_fifo))
+        wake_up_interruptible(&ar_samples_wq);
+}
+
+static ssize_t ar_samples_read(struct file *filp, char __user *ubuf,
+                               size_t cnt, loff_t *ppos)
+{
+    unsigned int copied = 0;
+    int ret;
+
+    /* Only whole records are handed out */
+    cnt = rounddown(cnt, sizeof(struct areg_sample));
+    if (cnt == 0)
+        return -EINVAL;
+
+    if (kfifo_is_empty(&ar_samples_fifo)) {
+        if (filp->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        ret = wait_event_interruptible(ar_samples_wq,
+                                       !kfifo_is_empty(&ar_samples_fifo));
+        if (ret)
+            return ret;
+    }
+
+    mutex_lock(&ar_samples_read_mutex);
+    ret = kfifo_to_user(&ar_samples_fifo, ubuf, cnt, &copied);
+    mutex_unlock(&ar_samples_read_mutex);
+
+    return ret ? ret : copied;
+}
+
+static const struct file_operations ar_samples_fops = {
+    .owner      = THIS_MODULE,
+    .read       = ar_samples_read,
+};
+
+/**************************************************************************
+ * debugfs
+ **************************************************************************/
+
+void ar_stats_init_debugfs(struct dentry *dir)
+{
+    debugfs_create_file("latency", 0644, dir, NULL, &ar_latency_fops);
+    debugfs_create_file("overhead", 0644, dir, NULL, &ar_overhead_fops);
+    debugfs_create_file("accuracy", 0644, dir, NULL, &ar_accuracy_fops);
+    debugfs_create_file("skid", 0444, dir, NULL, &ar_skid_fops);
+    debugfs_create_file("samples", 0400, dir, NULL, &ar_samples_fops);
+    debugfs_create_u64("samples_dropped", 0444, dir, &ar_samples_dropped);
+}
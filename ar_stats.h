@@ -0,0 +1,146 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#if !defined AR_STATS_H
+#define AR_STATS_H
+
+/* log2 buckets: bucket k holds values in [2^k, 2^(k+1)) */
+#define AR_LOG2_BUCKETS 32
+
+/* Hops between the PMU overflow and the throttler spinning on the core */
+enum ar_lat_hop {
+    AR_HOP_OVERFLOW_TO_IRQ_WORK = 0, /* NMI -> ar_handle_read_overflow */
+    AR_HOP_IRQ_WORK_TO_WAKEUP,       /* irq_work -> wake_up_interruptible() done */
+    AR_HOP_WAKEUP_TO_SPIN,           /* wakeup -> throttler scheduled in */
+    AR_HOP_OVERFLOW_TO_SPIN,         /* end to end */
+    AR_NR_HOPS
+};
+
+struct ar_log2_hist {
+    u64 bucket[AR_LOG2_BUCKETS];
+    u64 count;
+    u64 sum;
+    u64 max;
+};
+
+/* Per-core overflow to throttle latency accounting */
+struct ar_latency {
+    /* local_clock() stamps of the overflow currently being handled */
+    u64 t_overflow;
+    u64 t_irq_work;
+    u64 t_wakeup;
+
+    /* Counter value seen by the overflow callback */
+    u64 count_at_overflow;
+
+    /* Serializes the histograms between the core and debugfs */
+    spinlock_t lock;
+
+    struct ar_log2_hist hop[AR_NR_HOPS];
+
+    /* Events counted between the overflow and the spin starting */
+    struct ar_log2_hist overshoot;
+};
+
+/* Regulator code paths whose cost is charged to a regulated core */
+enum ar_ovh_path {
+    AR_OVH_TIMER = 0,   /* new_ar_regu_timer_callback() on the core */
+    AR_OVH_MASTER,      /* master's per-core work on CPU0 */
+    AR_OVH_THROTTLER,   /* throttler wakeup until it starts spinning */
+    AR_NR_OVH_PATHS
+};
+
+/*
+ * Per-core self-overhead of the regulator. Each path has a single writer;
+ * a concurrent reset from debugfs may at worst drop one sample.
+ */
+struct ar_overhead {
+    u64 ns[AR_NR_OVH_PATHS];
+    u64 calls[AR_NR_OVH_PATHS];
+
+    /* local_clock() at the last reset, base of the overhead percentage */
+    u64 t_reset;
+
+    /* Throttler context switches (nvcsw + nivcsw) at the last reset */
+    u64 ctxsw_reset;
+};
+
+/* Number of predictions per accuracy window */
+#define AR_ACC_WINDOW 1000
+
+/* Prediction error moments (MB/s) over a set of intervals */
+struct ar_acc_window {
+    u64 n;
+    u64 sum_abs;
+    u64 sum_sq;
+    s64 sum_err;
+    /* Intervals that ended with budget left / that overflowed */
+    u64 over;
+    u64 under;
+};
+
+/*
+ * Per-core online prediction accuracy. Error moments are written by the
+ * master; nr_over/nr_under are counted by the regulation timer on the core
+ * and folded into the windows by the master.
+ */
+struct ar_accuracy {
+    struct ar_acc_window life;
+    struct ar_acc_window cur;
+    struct ar_acc_window last;
+
+    u64 nr_over;
+    u64 nr_under;
+
+    /* nr_over/nr_under at the last reset and at the start of @cur */
+    u64 life_over_base;
+    u64 life_under_base;
+    u64 cur_over_base;
+    u64 cur_under_base;
+
+    /* Serializes the windows between the master and debugfs */
+    spinlock_t lock;
+};
+
+/* Largest skid compensation, in percent of the interval budget */
+#define AR_SKID_MAX_PCT 50
+
+/* Learned overshoot: EWMA with weight 1/8 and 8 bits of fraction */
+DECLARE_EWMA(ar_skid, 8, 8)
+
+/*
+ * Per-core overflow skid. The timer arms the counter at the budget minus
+ * the learned overshoot; the throttler measures how far past the armed
+ * period the core got before it started spinning. Both run on the core.
+ */
+struct ar_skid {
+    /* Interval being enforced, set by the timer */
+    u64 count_at_start;
+    u64 budget;
+    u64 armed;
+
+    struct ewma_ar_skid overshoot;
+    u64 nr_samples;
+    u64 last;
+};
+
+struct core_info;
+struct dentry;
+
+void ar_log2_hist_add(struct ar_log2_hist *h, u64 value);
+void ar_latency_record_spin(struct core_info *cinfo, u64 t_spin, u64 count_at_spin);
+void ar_overhead_add(struct core_info *cinfo, enum ar_ovh_path path, u64 ns);
+void ar_overhead_reset(struct core_info *cinfo);
+void ar_accuracy_record(struct core_info *cinfo, s64 error);
+u64 ar_skid_arm(struct core_info *cinfo, u64 budget, u64 count_now);
+void ar_skid_reset(struct core_info *cinfo);
+void ar_samples_push(struct core_info *cinfo);
+void ar_samples_wake(void);
+void ar_stats_init_debugfs(struct dentry *dir);
+
+#endif /* AR_STATS_H */
@@ -0,0 +1,170 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * Tracepoints for the regulator. Each event compiles to a static-key
+ * guarded branch that is patched out until it is enabled, e.g.
+ *   echo 1 > /sys/kernel/tracing/events/areg/enable
+ *   perf record -e 'areg:*' -a
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM areg
+
+#if !defined(AR_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define AR_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* New budget (in events) loaded into the counter at the start of an interval */
+TRACE_EVENT(areg_budget_update,
+
+    TP_PROTO(u8 cpu_id, u64 budget),
+
+    TP_ARGS(cpu_id, budget),
+
+    TP_STRUCT__entry(
+        __field(u8,  cpu_id)
+        __field(u64, budget)
+    ),
+
+    TP_fast_assign(
+        __entry->cpu_id = cpu_id;
+        __entry->budget = budget;
+    ),
+
+    TP_printk("cpu=%u budget=%llu", __entry->cpu_id, __entry->budget)
+);
+
+/* Counter exhausted its budget; handled in irq_work context */
+TRACE_EVENT(areg_overflow,
+
+    TP_PROTO(u8 cpu_id, u64 count),
+
+    TP_ARGS(cpu_id, count),
+
+    TP_STRUCT__entry(
+        __field(u8,  cpu_id)
+        __field(u64, count)
+    ),
+
+    TP_fast_assign(
+        __entry->cpu_id = cpu_id;
+        __entry->count  = count;
+    ),
+
+    TP_printk("cpu=%u count=%llu", __entry->cpu_id, __entry->count)
+);
+
+/* Throttler kthread starts spinning on the core */
+TRACE_EVENT(areg_throttle_start,
+
+    TP_PROTO(u8 cpu_id),
+
+    TP_ARGS(cpu_id),
+
+    TP_STRUCT__entry(
+        __field(u8, cpu_id)
+    ),
+
+    TP_fast_assign(
+        __entry->cpu_id = cpu_id;
+    ),
+
+    TP_printk("cpu=%u", __entry->cpu_id)
+);
+
+/* Throttler kthread released the core after @duration_ns */
+TRACE_EVENT(areg_throttle_end,
+
+    TP_PROTO(u8 cpu_id, u64 duration_ns),
+
+    TP_ARGS(cpu_id, duration_ns),
+
+    TP_STRUCT__entry(
+        __field(u8,  cpu_id)
+        __field(u64, duration_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->cpu_id      = cpu_id;
+        __entry->duration_ns = duration_ns;
+    ),
+
+    TP_printk("cpu=%u duration_ns=%llu", __entry->cpu_id, __entry->duration_ns)
+);
+
+/* Master computed the next estimate for a core (all values in MB/s) */
+TRACE_EVENT(areg_predict,
+
+    TP_PROTO(u8 cpu_id, u64 used_mb, s64 estimate_mb, s64 error),
+
+    TP_ARGS(cpu_id, used_mb, estimate_mb, error),
+
+    TP_STRUCT__entry(
+        __field(u8,  cpu_id)
+        __field(u64, used_mb)
+        __field(s64, estimate_mb)
+        __field(s64, error)
+    ),
+
+    TP_fast_assign(
+        __entry->cpu_id      = cpu_id;
+        __entry->used_mb     = used_mb;
+        __entry->estimate_mb = estimate_mb;
+        __entry->error       = error;
+    ),
+
+    TP_printk("cpu=%u used_mb=%llu estimate_mb=%lld error=%lld",
+              __entry->cpu_id, __entry->used_mb,
+              __entry->estimate_mb, __entry->error)
+);
+
+/* Timer and counter of an idle core suspended (parked=1) or resumed (parked=0) */
+TRACE_EVENT(areg_idle,
+
+    TP_PROTO(u8 cpu_id, bool parked),
+
+    TP_ARGS(cpu_id, parked),
+
+    TP_STRUCT__entry(
+        __field(u8,   cpu_id)
+        __field(bool, parked)
+    ),
+
+    TP_fast_assign(
+        __entry->cpu_id = cpu_id;
+        __entry->parked = parked;
+    ),
+
+    TP_printk("cpu=%u parked=%u", __entry->cpu_id, __entry->parked)
+);
+
+/* Mean loaded memory latency per hop of the master's pointer-chase probe */
+TRACE_EVENT(areg_mem_latency,
+
+    TP_PROTO(u64 latency_ps),
+
+    TP_ARGS(latency_ps),
+
+    TP_STRUCT__entry(
+        __field(u64, latency_ps)
+    ),
+
+    TP_fast_assign(
+        __entry->latency_ps = latency_ps;
+    ),
+
+    TP_printk("latency_ps=%llu", __entry->latency_ps)
+);
+
+#endif /* AR_TRACE_H */
+
+/* This part must be outside the multi-read protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE ar_trace
+#include <trace/define_trace.h>
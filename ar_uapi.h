@@ -0,0 +1,103 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * Definitions shared between the areg module and userspace tools.
+ * Keep this file free of kernel-only headers.
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#if !defined AR_UAPI_H
+#define AR_UAPI_H
+
+#include <linux/types.h>
+
+/**************************************************************************
+ * Predictors selectable per core
+ **************************************************************************/
+enum areg_predictor {
+    AREG_PRED_LMS = 0,   /* LMS over the last HIST_SIZE intervals (default) */
+    AREG_PRED_STATIC,    /* Setpoint only */
+    AREG_PRED_HIST_MAX,  /* Max of the last HIST_SIZE intervals */
+    AREG_NR_PREDICTORS
+};
+
+/**************************************************************************
+ * Per-interval samples, read as a stream of fixed-size records from
+ * /sys/kernel/debug/ar/samples (blocking unless O_NONBLOCK)
+ **************************************************************************/
+#define AREG_SAMPLE_F_THROTTLED  0x1  /* core throttled when sampled */
+
+struct areg_sample {
+    __u64 timestamp_ns;   /* ktime_get_ns() */
+    __u64 used_mb;        /* MB/s used in the last interval */
+    __s64 predicted_mb;   /* next estimate */
+    __u64 budget_mb;      /* budget loaded for the next interval */
+    __u64 overflows;      /* cumulative */
+    __u64 throttled_ns;   /* cumulative */
+    __u32 cpu;
+    __u32 flags;          /* AREG_SAMPLE_F_* */
+};
+
+/**************************************************************************
+ * Generic netlink family "areg"
+ *
+ * AREG_CMD_GET  request: -                     reply: globals + AREG_A_CORES
+ * AREG_CMD_SET  request: globals + AREG_A_CORES (validated as a whole,
+ *               then applied under one lock; CAP_NET_ADMIN)
+ * AREG_CMD_EVENT multicast on AREG_GENL_MCGRP_EVENTS once per master
+ *               iteration: AREG_A_TIMESTAMP_NS + AREG_A_CORES
+ *
+ * AREG_A_CORES is a nest of AREG_A_CORE nests, each one keyed by
+ * AREG_CORE_A_CPU.
+ **************************************************************************/
+#define AREG_GENL_NAME          "areg"
+#define AREG_GENL_VERSION       1
+#define AREG_GENL_MCGRP_EVENTS  "events"
+
+/* Longest regulation interval accepted (ms); MB/s <-> events stay within u64 */
+#define AREG_REGU_INTERVAL_MAX_MS 60000
+/* Largest per-core bandwidth accepted (MB/s), same reason */
+#define AREG_BW_MAX_MB            (1ULL << 24)
+
+enum areg_cmd {
+    AREG_CMD_UNSPEC = 0,
+    AREG_CMD_GET,
+    AREG_CMD_SET,
+    AREG_CMD_EVENT,
+    __AREG_CMD_MAX
+};
+#define AREG_CMD_MAX (__AREG_CMD_MAX - 1)
+
+enum areg_attr {
+    AREG_A_UNSPEC = 0,
+    AREG_A_REGU_INTERVAL_MS,    /* u32 */
+    AREG_A_OBS_INTERVAL_MS,     /* u32 */
+    AREG_A_ENABLE,              /* u8 */
+    AREG_A_CORES,               /* nest of AREG_A_CORE */
+    AREG_A_CORE,                /* nest of enum areg_core_attr */
+    AREG_A_TIMESTAMP_NS,        /* u64 */
+    AREG_A_PAD,
+    __AREG_A_MAX
+};
+#define AREG_A_MAX (__AREG_A_MAX - 1)
+
+enum areg_core_attr {
+    AREG_CORE_A_UNSPEC = 0,
+    AREG_CORE_A_CPU,            /* u32 */
+    AREG_CORE_A_SETPOINT_MB,    /* u64, rw */
+    AREG_CORE_A_MAX_MB,         /* u64, rw */
+    AREG_CORE_A_PREDICTOR,      /* u8 enum areg_predictor, rw */
+    AREG_CORE_A_USED_MB,        /* u64, ro */
+    AREG_CORE_A_PREDICTED_MB,   /* s64, ro */
+    AREG_CORE_A_BUDGET_MB,      /* u64, ro */
+    AREG_CORE_A_OVERFLOWS,      /* u64, ro */
+    AREG_CORE_A_THROTTLED_NS,   /* u64, ro */
+    AREG_CORE_A_THROTTLED,      /* u8, ro */
+    AREG_CORE_A_PAD,
+    __AREG_CORE_A_MAX
+};
+#define AREG_CORE_A_MAX (__AREG_CORE_A_MAX - 1)
+
+#endif /* AR_UAPI_H */
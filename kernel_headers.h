@@ -7,6 +7,13 @@
 
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 
+#if !defined(__KERNEL__)
+/* Userspace build of the shared logic (model.c) for the tools/ replay */
+#  if !defined(KBUILD_MODNAME)
+#    define KBUILD_MODNAME "areg"
+#  endif
+#  include "tools/include/ar_shim.h"
+#else
 #include <linux/version.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
@@ -25,12 +32,14 @@
 #include <linux/uaccess.h>
 #include <linux/notifier.h>
 #include <linux/kthread.h>
+#include <linux/mutex.h>
 #include <linux/printk.h>
 #include <linux/interrupt.h>
 #include <linux/trace_events.h>
 #include <linux/cpumask.h>
 #include <linux/topology.h>
 #include <linux/kfifo.h>
+#include <linux/average.h>
 #include <asm/fpu/api.h>
 #include <linux/init.h>
 #include <linux/hw_breakpoint.h>
@@ -45,6 +54,7 @@
 #  include <linux/sched/rt.h>
 #endif
 #include <linux/sched.h>
+#endif /* __KERNEL__ */
 
 #if defined CONFIG_DEBUG_AR
 #define AR_DEBUG(fmt, ...) trace_printk(pr_fmt(fmt), ##__VA_ARGS__)
@@ -4,6 +4,12 @@
 #include "ar_perfs.h"
 #include "utils.h"
 #include "model.h"
+#include "ar_trace.h"
+#include "ar_stats.h"
+#include "ar_debugfs.h"
+#include "ar_netlink.h"
+#include "ar_group.h"
+#include "ar_probe.h"
 
 static struct task_struct* mthread = NULL;
 
@@ -11,9 +17,6 @@ static struct task_struct* mthread = NULL;
 static void throttle( u8 cpu_id) __attribute__((unused));
 static void unthrottle( u8 cpu_id) __attribute__((unused));
 
-/* External Functions */
-extern u64 estimate(u64* feat, u8 feat_len, double *wm, u8 wm_len, u8 index);
-extern void update_weight_matrix(s64 error,struct core_info* cinfo );
 /* External Variables / constants */
 extern u64 g_bw_intial_setpoint_mb[MAX_NO_CPUS+1];/*Pre-defined initial / min Bandwidth in MB/s */
 extern u64 g_bw_max_mb[MAX_NO_CPUS+1]; /*Pre-defined max Bandwidth per core in MB/s */
@@ -49,6 +52,82 @@ static void unthrottle( u8 cpu_id) {
 }
 
 
+/* Per-interval bookkeeping of one regulated core: measure, predict, set budget */
+static void master_regulate_core(u8 cpu_id)
+{
+    struct core_info* cinfo = get_core_info(cpu_id);
+    WARN_ON(cinfo == NULL);
+    WARN_ON(cinfo->read_event == NULL);
+
+    struct perf_event* read_event = cinfo->read_event;
+
+    /* Budget in force while the usage below was consumed */
+    u64 live_budget_mb = READ_ONCE(cinfo->budget_mb);
+
+    cinfo->g_read_count_old = cinfo->g_read_count_new;
+    cinfo->g_read_count_new = convert_events_to_mb( perf_event_count(read_event)) ;
+    /* Average over the time since the last prediction, in MB/s */
+    cinfo->g_read_count_used = div64_u64((cinfo->g_read_count_new -
+                                          cinfo->g_read_count_old) *
+                                         get_regulation_time() * NSEC_PER_MSEC,
+                                         ar_adapt_span_ns(&cinfo->adapt, local_clock()));
+
+    s64 error;
+    if (!model_step(cinfo, cinfo->g_read_count_used,
+                    READ_ONCE(g_bw_intial_setpoint_mb[cpu_id]), &error)) {
+		AR_DEBUG("CPU(%u): Negative Estimate=%lld \n",cpu_id,cinfo->next_estimate);
+        return;
+    }
+	
+    //TODO: When estimate crosses a thrhold 
+    // if (cinfo->next_estimate > g_bw_max_mb[cpu_id]){
+	// 	AR_DEBUG("CPU(%u): Estimated(%u) = %lld > Max Limit \n",cpu_id, cinfo->next_estimate);
+	// 	cinfo->next_estimate = g_bw_max_mb[cpu_id];
+	// }
+
+
+    atomic64_set(&cinfo->budget_est, convert_mb_to_events(cinfo->next_estimate));
+    WRITE_ONCE(cinfo->budget_mb, cinfo->next_estimate);
+
+    ar_accuracy_record(cinfo, error);
+    ar_adapt_update(&cinfo->adapt, error, cinfo->prev_estimate);
+    ar_shadow_step(cinfo, live_budget_mb);
+    trace_areg_predict(cpu_id, cinfo->g_read_count_used,
+                       cinfo->next_estimate, error);
+
+    /* Weights as "w0 w1 ..." for the debug log */
+    char buf[HIST_SIZE * (DOUBLE_LEN + 1) + 1] = {0};
+    char *pos = buf;
+    for (u8 i = 0; i < HIST_SIZE; i++){
+        kernel_fpu_begin();
+        print_double(pos, cinfo->weight_matrix[i]);
+        kernel_fpu_end();
+        pos += strlen(pos);
+        *pos++ = ' ';
+    }
+    pos[-1] = '\0';
+
+    AR_DEBUG("CPU(%u):Used=%llu nxt_est=%lld err=%lld w=%s\n",
+                 cpu_id,
+                 cinfo->g_read_count_used,
+                 cinfo->next_estimate,
+                 error,
+                 buf);
+    model_advance(cinfo);
+}
+
+/* True once the core's interval is over; parked idle cores have nothing new to predict from */
+static bool master_core_due(u8 cpu_id, u64 now)
+{
+    struct core_info *cinfo = get_core_info(cpu_id);
+
+    if (READ_ONCE(cinfo->parked)) {
+        ar_adapt_hold(&cinfo->adapt, now);
+        return false;
+    }
+    return ar_adapt_due(&cinfo->adapt, get_regulation_time(), now);
+}
+
 static int master_thread_func(void * data) {
     pr_info("%s: Enter",__func__);
 
@@ -56,75 +135,44 @@ static int master_thread_func(void * data) {
 
     while (!kthread_should_stop() ) {
         u8 cpu_id;
+        u8 done = 0;
         if (kthread_should_stop()){
         	pr_info("Stopping thread %s\n",__func__);
             break;
         }
+        /* Configuration changes apply between iterations, never half-way */
+        ar_ctrl_lock();
         for_each_online_cpu(cpu_id){
             switch(cpu_id){
                 case 1:
                 case 2:
                 case 3:
                 case 4:
-                    struct core_info* cinfo = get_core_info(cpu_id);
-                    WARN_ON(cinfo == NULL);
-                    WARN_ON(cinfo->read_event == NULL);
-
-                    struct perf_event* read_event = cinfo->read_event;
-
-                    cinfo->g_read_count_old = cinfo->g_read_count_new;
-                    cinfo->g_read_count_new = convert_events_to_mb( perf_event_count(read_event)) ;
-                    cinfo->g_read_count_used = cinfo->g_read_count_new -
-                                                    cinfo->g_read_count_old;
-
-                    cinfo->read_event_hist[cinfo->ri] = cinfo->g_read_count_used;
-                    cinfo->next_estimate = estimate( cinfo->read_event_hist,
-                                                     sizeof(cinfo->read_event_hist)/sizeof(cinfo->read_event_hist[0]),
-                                                     cinfo->weight_matrix,
-                                                     sizeof(cinfo->weight_matrix)/sizeof(cinfo->weight_matrix[0]),
-                                                     cinfo->ri) + g_bw_intial_setpoint_mb[cpu_id];
-                    
-                    if(cinfo->next_estimate < 0){
-						AR_DEBUG("CPU(%u): Negative Estimate=%lld \n",cpu_id,cinfo->next_estimate);
-                        //scale down the weights
-                        initialize_weight_matrix(cinfo, false);
+                    if (!master_core_due(cpu_id, local_clock()))
                         continue;
-                    }
-					
-                    //TODO: When estimate crosses a thrhold 
-                    // if (cinfo->next_estimate > g_bw_max_mb[cpu_id]){
-					// 	AR_DEBUG("CPU(%u): Estimated(%u) = %lld > Max Limit \n",cpu_id, cinfo->next_estimate);
-					// 	cinfo->next_estimate = g_bw_max_mb[cpu_id];
-					// }
-
-
-                    atomic64_set(&cinfo->budget_est, convert_mb_to_events(cinfo->next_estimate));
-
-                    s64 error = cinfo->g_read_count_used - cinfo->prev_estimate;
-                    update_weight_matrix(error,cinfo);
-
-                    char buf[HIST_SIZE][51]={0};    
-                        for (u8 i = 0; i < HIST_SIZE; i++){
-                         kernel_fpu_begin();
-                         print_double(buf[i],cinfo->weight_matrix[i]);
-                         kernel_fpu_end();
-                    }
-
-
-                    (cinfo->ri)++;
-                    cinfo->ri = (cinfo->ri == HIST_SIZE)? 0:cinfo->ri;
-                    AR_DEBUG("CPU(%u):Used=%llu nxt_est=%lld err=%lld w0=%s w1=%s w2=%s w3=%s w4=%s\n",
-                                 cpu_id,
-                                 cinfo->g_read_count_used,
-                                 cinfo->next_estimate,
-                                 error,
-                                 buf[0],buf[1],buf[2],buf[3], buf[4]);
-                    cinfo->prev_estimate=cinfo->next_estimate;
+                    u64 t_start = local_clock();
+                    master_regulate_core(cpu_id);
+                    ar_overhead_add(get_core_info(cpu_id), AR_OVH_MASTER,
+                                    local_clock() - t_start);
+                    done |= BIT(cpu_id);
                     break;
                 default:
                     continue;
             }
         }
+
+        /* Group SLAs override the budgets of grouped cores */
+        ar_groups_distribute();
+        /* ... and no budget applies while memory is not contended */
+        ar_probe_run();
+        ar_gate_apply();
+        for (cpu_id = 1; cpu_id <= MAX_NO_CPUS; cpu_id++)
+            if (done & BIT(cpu_id))
+                ar_samples_push(get_core_info(cpu_id));
+        ar_ctrl_unlock();
+
+        ar_samples_wake();
+        ar_nl_notify_cores();
        msleep(1);
     }
 
@@ -1,6 +1,7 @@
 #include "kernel_headers.h"
 #include "ar.h"
 #include "model.h"
+#include "ar_uapi.h"
 /**********************  Static Function Prototypes **********************************************/
 static double lms_predict(const u64* feat, u8 feat_len,double *wm, u8 wm_len, u8 ri);
 //static double avg(const u64 * f , u8 len );
@@ -12,8 +13,16 @@ u64 estimate(u64* feat, u8 feat_len, double *wm, u8 wm_len, u8 index);
 void update_weight_matrix(s64 error, struct core_info *cinfo );
 void init_weight_matrix(struct core_info *cinfo);
 
-/** Constants **/
-const double  LRATE = 0.000001;
+/** Tunables **/
+/* LMS learning rate in units of 1e-9 (1000 = 1e-6) */
+u32 ar_lrate_ppb = 1000;
+module_param_named(lrate_ppb, ar_lrate_ppb, uint, 0644);
+MODULE_PARM_DESC(lrate_ppb, "LMS learning rate in units of 1e-9");
+
+/* Initial LMS weight in units of 1e-6 */
+u32 ar_initial_weight_ppm = INITIAL_WEIGHT_PPM;
+module_param_named(initial_weight_ppm, ar_initial_weight_ppm, uint, 0644);
+MODULE_PARM_DESC(initial_weight_ppm, "Initial LMS weight in units of 1e-6");
 
 
 
@@ -62,6 +71,74 @@ u64 estimate(u64* feat, u8 feat_len, double *wm, u8 wm_len, u8 index) {
     return integer_part;
 }
 
+/* Next estimate (MB/s) for @cinfo using @predictor, before the setpoint is added */
+s64 predict(struct core_info *cinfo, u8 predictor)
+{
+    return predict_wm(cinfo, predictor, cinfo->weight_matrix);
+}
+
+/* As predict(), with LMS weights @wm instead of the core's own */
+s64 predict_wm(struct core_info *cinfo, u8 predictor, double *wm)
+{
+    u64 max = 0;
+
+    switch (predictor) {
+    case AREG_PRED_STATIC:
+        return 0;
+    case AREG_PRED_HIST_MAX:
+        for (u8 i = 0; i < HIST_SIZE; i++)
+            max = max_t(u64, max, cinfo->read_event_hist[i]);
+        return max;
+    case AREG_PRED_LMS:
+    default:
+        return estimate(cinfo->read_event_hist, HIST_SIZE,
+                        wm, HIST_SIZE, cinfo->ri);
+    }
+}
+
+/*
+ * One master step of the LMS pipeline on the usage (MB/s) of the interval
+ * that just ended: record it in the history, predict the next interval on
+ * top of @setpoint_mb and learn from the error of the previous prediction.
+ * Returns false, with the weights scaled down and the history index left
+ * as is, if the estimate went negative. Shared with the userspace replay.
+ */
+bool model_step(struct core_info *cinfo, u64 used, u64 setpoint_mb, s64 *error)
+{
+    cinfo->read_event_hist[cinfo->ri] = used;
+    cinfo->next_estimate = model_step_wm(cinfo, READ_ONCE(cinfo->predictor),
+                                         cinfo->weight_matrix, used,
+                                         cinfo->prev_estimate, setpoint_mb, error);
+    return cinfo->next_estimate >= 0;
+}
+
+/*
+ * As model_step() on weights @wm, with @used already in the history of
+ * @cinfo and @prev_estimate the last prediction made with @wm. Returns the
+ * estimate; if negative, @wm is scaled down and *@error is not set.
+ */
+s64 model_step_wm(struct core_info *cinfo, u8 predictor, double *wm, u64 used,
+                  s64 prev_estimate, u64 setpoint_mb, s64 *error)
+{
+    s64 estimate = predict_wm(cinfo, predictor, wm) + setpoint_mb;
+
+    if (estimate < 0) {
+        initialize_weights(wm, false);
+        return estimate;
+    }
+
+    *error = used - prev_estimate;
+    update_weights(*error, cinfo, wm);
+    return estimate;
+}
+
+/* Close the step: move to the next history slot, remember the estimate */
+void model_advance(struct core_info *cinfo)
+{
+    cinfo->ri = (cinfo->ri + 1 == HIST_SIZE) ? 0 : cinfo->ri + 1;
+    cinfo->prev_estimate = cinfo->next_estimate;
+}
+
 static u64 l2_norm(u64* feature, u8 feat_len){
     u64 norm_sq = 0;
     for (u8 i = 0; i < feat_len; ++i) {
@@ -72,8 +149,12 @@ static u64 l2_norm(u64* feature, u8 feat_len){
 
 void 
 update_weight_matrix(s64 error,struct core_info* cinfo ){
-    
-    
+    update_weights(error, cinfo, cinfo->weight_matrix);
+}
+
+/* LMS step of weights @wm on the history of @cinfo */
+void update_weights(s64 error, struct core_info *cinfo, double *wm)
+{
     // Avoid Divide by zero error
     u64 norm_sq = l2_norm(cinfo->read_event_hist, HIST_SIZE);
     if ( 0 == norm_sq){
@@ -93,9 +174,9 @@ update_weight_matrix(s64 error,struct core_info* cinfo ){
     for (u8 i = 0; i <HIST_SIZE ; ++i) {
         u64 t1 = mul_u64_u64_shr(error,cinfo->read_event_hist[i],0);
         double  t2 = t1 / norm_sq;
-        product[i] = t2 * LRATE;
+        product[i] = t2 * (READ_ONCE(ar_lrate_ppb) * 1e-9);
         // Sign bit is used while updating the weight vector
-        cinfo->weight_matrix[i] = cinfo->weight_matrix[i] + (sign_bit * product[i]);
+        wm[i] = wm[i] + (sign_bit * product[i]);
     }
     kernel_fpu_end();
     
@@ -127,10 +208,14 @@ update_weight_matrix(s64 error,struct core_info* cinfo ){
 }
 
 void initialize_weight_matrix(struct core_info *cinfo, bool first){
+    initialize_weights(cinfo->weight_matrix, first);
+}
+
+void initialize_weights(double *wm, bool first){
 
     kernel_fpu_begin();
   	for(u8 i =0 ; i < HIST_SIZE; i++){
-       	cinfo->weight_matrix[i] = (first)? INITIAL_WEIGHT : (cinfo->weight_matrix[i])/2;
+       	wm[i] = (first)? READ_ONCE(ar_initial_weight_ppm) * 1e-6 : (wm[i])/2;
   	}
     kernel_fpu_end();
 
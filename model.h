@@ -6,8 +6,23 @@
 #define ADAPTIVEREGULATOR_MODEL_H
 
 
-#define INITIAL_WEIGHT  0.1f
+/* Default initial weight, 0.1 (ar_initial_weight_ppm) */
+#define INITIAL_WEIGHT_PPM  100000
+
+extern u32 ar_lrate_ppb;
+extern u32 ar_initial_weight_ppm;
+
 void initialize_weight_matrix(struct core_info *cinfo, bool first);
 void update_weight_matrix(s64 error, struct core_info *cinfo );
 u64 estimate(u64* feat, u8 feat_len, double *wm, u8 wm_len, u8 index);
+s64 predict(struct core_info *cinfo, u8 predictor);
+bool model_step(struct core_info *cinfo, u64 used, u64 setpoint_mb, s64 *error);
+void model_advance(struct core_info *cinfo);
+
+/* Same, on a separate set of LMS weights (e.g. the shadow predictor) */
+void initialize_weights(double *wm, bool first);
+void update_weights(s64 error, struct core_info *cinfo, double *wm);
+s64 predict_wm(struct core_info *cinfo, u8 predictor, double *wm);
+s64 model_step_wm(struct core_info *cinfo, u8 predictor, double *wm, u64 used,
+                  s64 prev_estimate, u64 setpoint_mb, s64 *error);
 #endif //ADAPTIVEREGULATOR_MODEL_H
@@ -0,0 +1,57 @@
+#! /bin/bash
+
+# Build and load the areg module with a configuration written by
+# areg_tune.py (key=value lines: hist_size, lrate_ppb, initial_weight_ppm,
+# regu_interval, setpoint_mb).
+#
+#   areg_load_config.sh CONFIG [MODULE_DIR]
+
+export DEBUGFS_AR_PATH=/sys/kernel/debug/ar
+
+if [ $# -lt 1 ]; then
+   echo "usage: $0 CONFIG [MODULE_DIR]"
+   exit 1
+fi
+CONFIG=$1
+MODULE_DIR=${2:-$(dirname "$(readlink -f "$0")")/..}
+
+if [ "$EUID" -ne 0 ]; then
+   echo "Please run as root or use sudo"
+   exit 1
+fi
+
+hist_size=""
+lrate_ppb=""
+initial_weight_ppm=""
+regu_interval=""
+setpoint_mb=""
+while IFS='=' read -r key value; do
+   case "$key" in
+      hist_size|lrate_ppb|initial_weight_ppm|regu_interval|setpoint_mb)
+         printf -v "$key" '%s' "$value" ;;
+   esac
+done < "$CONFIG"
+
+for key in hist_size lrate_ppb initial_weight_ppm regu_interval setpoint_mb; do
+   if [ -z "${!key}" ]; then
+      echo "$CONFIG: missing $key"
+      exit 1
+   fi
+done
+
+echo "Building areg with HIST_SIZE=$hist_size..."
+make -C "$MODULE_DIR" AR_HIST_SIZE="$hist_size" || exit 1
+
+if lsmod | grep -q "^areg "; then
+   echo "Unloading areg..."
+   rmmod areg || exit 1
+fi
+
+# Core 0 runs the master and is not regulated
+echo "Loading areg: lrate_ppb=$lrate_ppb initial_weight_ppm=$initial_weight_ppm setpoint_mb=$setpoint_mb"
+insmod "$MODULE_DIR/areg.ko" lrate_ppb="$lrate_ppb" initial_weight_ppm="$initial_weight_ppm" \
+   setpoint_mb=0,"$setpoint_mb","$setpoint_mb","$setpoint_mb","$setpoint_mb" || exit 1
+
+echo "$regu_interval" > $DEBUGFS_AR_PATH/regu_interval
+echo "regu_interval: $(cat $DEBUGFS_AR_PATH/regu_interval) ms"
+echo "DONE"
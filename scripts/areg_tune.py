@@ -0,0 +1,201 @@
+#!/usr/bin/env python3
+
+"""
+areg_tune.py - Offline tuning of the regulator's predictor parameters
+
+Description:
+    Replays recorded demand traces through the module's own model.c
+    (tools/areg-replay-hN, one binary per LMS history length) for a grid of
+    parameter sets, then zooms in around the best set for a few refinement
+    rounds. Evaluations are spread over all CPUs. The winner is written as
+    a key=value config that scripts/areg_load_config.sh applies.
+
+    Parameters searched:
+        hist_size           LMS history length (compile time, AR_HIST_SIZE)
+        lrate_ppb           LMS learning rate in 1e-9 units (module param)
+        initial_weight_ppm  initial LMS weight in 1e-6 units (module param)
+        regu_interval       regulation interval in ms (debugfs ar/regu_interval)
+        setpoint_mb         per core setpoint in MB/s (module param)
+
+    Objective (lower is better), summed over all cores of all traces:
+        mispredict_pct + THROTTLE_WEIGHT * throttled_pct
+
+Usage:
+    ./areg_tune.py TRACE... [-o areg.conf] [--throttle-weight W] [--refine N]
+                   [--hist-sizes 2,3,4] [--lrate-ppb ...] [--initial-weight-ppm ...]
+                   [--interval-ms ...] [--setpoint-mb ...] [-j JOBS]
+
+    TRACE is an areg-collect .arc or a "t_ms, cpu, ..., mb" CSV recorded
+    with ar/monitor_only=1 and ar/regu_interval=1 (see --sample-ms).
+
+Date: 2026-10-18
+"""
+
+import argparse
+import itertools
+import os
+import subprocess
+import sys
+from concurrent.futures import ThreadPoolExecutor
+from typing import List, Tuple
+
+#==============================================================================
+# CONFIGURATION
+#==============================================================================
+
+TOOLS_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tools")
+
+DEFAULT_HIST_SIZES = "2,3,4,5,6,8"
+DEFAULT_LRATE_PPB = "10,100,1000,10000,100000"
+DEFAULT_INITIAL_WEIGHT_PPM = "10000,50000,100000,200000,500000"
+DEFAULT_INTERVAL_MS = "1,2,5,10"
+DEFAULT_SETPOINT_MB = "250,500,1000,2000,4000"
+
+# (hist_size, lrate_ppb, initial_weight_ppm, interval_ms, setpoint_mb)
+Params = Tuple[int, int, int, int, int]
+# (objective, mispredict_pct, throttled_pct, params)
+Result = Tuple[float, float, float, Params]
+
+#==============================================================================
+# UTILITY FUNCTIONS
+#==============================================================================
+
+def error_exit(message: str, exit_code: int = 2) -> None:
+    """Print error message and exit."""
+    print(f"ERROR: {message}", file=sys.stderr)
+    sys.exit(exit_code)
+
+
+def int_list(text: str) -> List[int]:
+    try:
+        values = sorted({int(v) for v in text.split(",") if v.strip()})
+    except ValueError:
+        error_exit(f"not a list of integers: {text}")
+    if not values or values[0] <= 0:
+        error_exit(f"values must be > 0: {text}")
+    return values
+
+
+def replay_binary(hist_size: int) -> str:
+    path = os.path.join(TOOLS_DIR, f"areg-replay-h{hist_size}")
+    if not os.access(path, os.X_OK):
+        error_exit(f"{path} not found (make -C tools REPLAY_HIST=\"... {hist_size}\")")
+    return path
+
+#==============================================================================
+# EVALUATION
+#==============================================================================
+
+def run_chunk(args: argparse.Namespace, hist_size: int, chunk: List[Params]) -> List[Result]:
+    """One areg-replay process scoring a list of parameter sets."""
+    cmd = [replay_binary(hist_size), "-s", str(args.sample_ms),
+           "-w", str(args.throttle_weight)] + args.traces
+    stdin = "".join(f"{p[1]} {p[2]} {p[3]} {p[4]}\n" for p in chunk)
+    proc = subprocess.run(cmd, input=stdin, capture_output=True, text=True)
+    if proc.returncode != 0:
+        error_exit(f"{' '.join(cmd)}: {proc.stderr.strip()}", 1)
+
+    results = []
+    for line in proc.stdout.splitlines():
+        f = line.split()
+        params = tuple(int(v) for v in f[:5])
+        results.append((float(f[5]), float(f[6]), float(f[7]), params))
+    return results
+
+
+def evaluate(args: argparse.Namespace, candidates: List[Params]) -> List[Result]:
+    """Score all candidates, one chunk per job and history length."""
+    by_hist = {}
+    for p in candidates:
+        by_hist.setdefault(p[0], []).append(p)
+
+    work = []
+    for hist_size, params in by_hist.items():
+        n = max(1, min(args.jobs, len(params)))
+        work += [(hist_size, params[i::n]) for i in range(n)]
+
+    with ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        chunks = pool.map(lambda w: run_chunk(args, *w), work)
+        return sorted(r for chunk in chunks for r in chunk)
+
+
+def neighbourhood(best: Params, step: float) -> List[Params]:
+    """Multiplicative zoom around @best; the history length stays fixed."""
+    hist_size, lrate, weight, interval, setpoint = best
+    factors = (1 / step, 1 / (step ** 0.5), 1.0, step ** 0.5, step)
+    lrates = {max(1, round(lrate * f)) for f in factors}
+    weights = {max(1, round(weight * f)) for f in factors}
+    setpoints = {max(1, round(setpoint * f)) for f in factors}
+    intervals = {interval, max(1, interval - 1), interval + 1}
+    return [(hist_size, l, w, i, s)
+            for l, w, i, s in itertools.product(lrates, weights, intervals, setpoints)]
+
+#==============================================================================
+# MAIN
+#==============================================================================
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Tune the regulator by trace replay")
+    parser.add_argument("traces", nargs="+")
+    parser.add_argument("-o", "--output", default="areg.conf")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count() or 1)
+    parser.add_argument("--sample-ms", type=int, default=1,
+                        help="interval the traces were recorded at")
+    parser.add_argument("--throttle-weight", type=float, default=1.0,
+                        help="cost of one percent of throttled time vs mispredicted bandwidth")
+    parser.add_argument("--refine", type=int, default=3, help="zoom rounds after the grid")
+    parser.add_argument("--hist-sizes", default=DEFAULT_HIST_SIZES)
+    parser.add_argument("--lrate-ppb", default=DEFAULT_LRATE_PPB)
+    parser.add_argument("--initial-weight-ppm", default=DEFAULT_INITIAL_WEIGHT_PPM)
+    parser.add_argument("--interval-ms", default=DEFAULT_INTERVAL_MS)
+    parser.add_argument("--setpoint-mb", default=DEFAULT_SETPOINT_MB)
+    parser.add_argument("--top", type=int, default=5, help="results to print")
+    args = parser.parse_args()
+
+    if args.jobs <= 0 or args.sample_ms <= 0:
+        error_exit("--jobs and --sample-ms must be > 0")
+    for t in args.traces:
+        if not os.path.isfile(t):
+            error_exit(f"{t}: no such trace")
+
+    intervals = [i for i in int_list(args.interval_ms) if i % args.sample_ms == 0]
+    if not intervals:
+        error_exit("no interval is a multiple of --sample-ms")
+    grid = list(itertools.product(int_list(args.hist_sizes), int_list(args.lrate_ppb),
+                                  int_list(args.initial_weight_ppm), intervals,
+                                  int_list(args.setpoint_mb)))
+
+    print(f"grid: {len(grid)} parameter sets, {args.jobs} jobs", file=sys.stderr)
+    results = evaluate(args, grid)
+    seen = {r[3] for r in results}
+
+    step = 4.0
+    for rnd in range(args.refine):
+        candidates = [p for p in neighbourhood(results[0][3], step)
+                      if p not in seen and p[3] % args.sample_ms == 0]
+        print(f"refine {rnd + 1}: {len(candidates)} parameter sets around "
+              f"objective {results[0][0]:.4f}", file=sys.stderr)
+        seen.update(candidates)
+        if candidates:
+            results = sorted(results + evaluate(args, candidates))
+        step = step ** 0.5
+
+    print("# objective, mispredict_pct, throttled_pct, hist_size, lrate_ppb, "
+          "initial_weight_ppm, regu_interval, setpoint_mb")
+    for obj, mis, thr, p in results[:args.top]:
+        print(f"{obj:.4f}, {mis:.4f}, {thr:.4f}, " + ", ".join(str(v) for v in p))
+
+    obj, mis, thr, best = results[0]
+    with open(args.output, "w") as f:
+        f.write(f"# areg_tune.py over {' '.join(os.path.basename(t) for t in args.traces)}\n")
+        f.write(f"# objective {obj:.4f}: mispredict {mis:.2f}%, throttled {thr:.2f}%, "
+                f"throttle weight {args.throttle_weight:g}\n")
+        for key, value in zip(("hist_size", "lrate_ppb", "initial_weight_ppm",
+                               "regu_interval", "setpoint_mb"), best):
+            f.write(f"{key}={value}\n")
+    print(f"best configuration written to {args.output}", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,329 @@
+#!/usr/bin/env python3
+
+"""
+regression_suite.py - Regulator performance regression suite
+
+Description:
+    Runs an areg-bench plan N times, summarises every configuration with
+    bootstrap confidence intervals and compares it against a stored
+    baseline. The exit status flags statistically significant regressions,
+    so regulator changes can be gated on performance.
+
+Usage:
+    ./regression_suite.py run     PLAN -n RUNS -o results.jsonl [--bench PATH]
+    ./regression_suite.py report  results.jsonl
+    ./regression_suite.py compare results.jsonl --baseline FILE [--save-baseline]
+                                  [--min-effect PCT] [--confidence PCT]
+
+Configurations:
+    One configuration is one run name of the plan under one set of `ar`
+    settings. Runs are named FG+BG...; the run named FG (the foreground
+    alone) is the reference of every FG+... run:
+
+        slowdown          = mean(IPC of FG alone) / mean(IPC of FG in the pair)
+        fg_throttled_pct  = throttled time of the foreground / run time
+        bg_throttled_pct  = same for the background workloads
+
+    Throttled time needs the areg PMU (areg/throttled_ns) to be present.
+
+Statistics:
+    Percentile bootstrap over the per-run samples (the reference and the
+    pair are resampled independently). A metric regresses when the whole
+    confidence interval of (current - baseline) is above zero and the
+    change is at least --min-effect percent of the baseline. All metrics
+    are "lower is better".
+
+Exit status:
+    0  no significant regression
+    1  at least one significant regression
+    2  usage or input error
+
+Date: 2026-10-18
+"""
+
+import argparse
+import json
+import os
+import random
+import subprocess
+import sys
+from typing import Dict, List, Optional, Tuple
+
+#==============================================================================
+# CONFIGURATION
+#==============================================================================
+
+DEFAULT_BENCH = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                             "..", "tools", "areg-bench")
+DEFAULT_RESAMPLES = 5000
+DEFAULT_CONFIDENCE = 95.0
+DEFAULT_MIN_EFFECT = 2.0
+BASELINE_VERSION = 1
+
+METRICS = ("slowdown", "fg_throttled_pct", "bg_throttled_pct")
+
+#==============================================================================
+# UTILITY FUNCTIONS
+#==============================================================================
+
+def error_exit(message: str, exit_code: int = 2) -> None:
+    """Print error message and exit."""
+    print(f"ERROR: {message}", file=sys.stderr)
+    sys.exit(exit_code)
+
+
+def mean(xs: List[float]) -> float:
+    return sum(xs) / len(xs)
+
+
+def percentile(sorted_xs: List[float], pct: float) -> float:
+    """Linear interpolation between closest ranks of a sorted list."""
+    k = (len(sorted_xs) - 1) * pct / 100.0
+    lo = int(k)
+    hi = min(lo + 1, len(sorted_xs) - 1)
+    return sorted_xs[lo] + (sorted_xs[hi] - sorted_xs[lo]) * (k - lo)
+
+
+def resample(rng: random.Random, xs: List[float]) -> List[float]:
+    return rng.choices(xs, k=len(xs))
+
+#==============================================================================
+# DATA LOADING FUNCTIONS
+#==============================================================================
+
+def config_key(record: dict) -> str:
+    """Run name plus the module settings it ran under."""
+    settings = record.get("settings", {})
+    if not settings:
+        return record["run"]
+    return record["run"] + " [" + ",".join(f"{k}={v}" for k, v in sorted(settings.items())) + "]"
+
+
+def reference_key(record: dict) -> Optional[str]:
+    """Configuration of the foreground alone, None for references themselves."""
+    name = record["run"]
+    if "+" not in name:
+        return None
+    return config_key(dict(record, run=name.split("+", 1)[0]))
+
+
+def throttled_pct(workloads: List[dict], elapsed_ms: float) -> Optional[float]:
+    ns = [w["throttled_ns"] for w in workloads if "throttled_ns" in w]
+    if not ns or elapsed_ms <= 0:
+        return None
+    return 100.0 * mean(ns) / (elapsed_ms * 1e6)
+
+
+def load_samples(path: str) -> Dict[str, Dict[str, List[float]]]:
+    """
+    Per configuration sample lists:
+        fg_ipc, ref_ipc, fg_throttled_pct, bg_throttled_pct
+    """
+    records = []
+    try:
+        with open(path) as f:
+            for line in f:
+                line = line.strip()
+                if line:
+                    records.append(json.loads(line))
+    except (OSError, ValueError) as e:
+        error_exit(f"{path}: {e}")
+
+    ipc: Dict[str, List[float]] = {}
+    configs: Dict[str, Dict[str, List[float]]] = {}
+    for r in records:
+        fg = r["workloads"][0]
+        if "ipc" in fg:
+            ipc.setdefault(config_key(r), []).append(fg["ipc"])
+
+    for r in records:
+        ref = reference_key(r)
+        if ref is None:
+            continue
+        if ref not in ipc:
+            # Fall back to the reference under any settings
+            name = r["run"].split("+", 1)[0]
+            ref = next((k for k in ipc if k == name or k.startswith(name + " [")), None)
+        c = configs.setdefault(config_key(r), {
+            "fg_ipc": [], "ref_ipc": ipc.get(ref, []) if ref else [],
+            "fg_throttled_pct": [], "bg_throttled_pct": []})
+
+        fg = r["workloads"][0]
+        if "ipc" in fg:
+            c["fg_ipc"].append(fg["ipc"])
+        t = throttled_pct(r["workloads"][:1], r["elapsed_ms"])
+        if t is not None:
+            c["fg_throttled_pct"].append(t)
+        t = throttled_pct(r["workloads"][1:], r["elapsed_ms"])
+        if t is not None:
+            c["bg_throttled_pct"].append(t)
+    return configs
+
+#==============================================================================
+# STATISTICS
+#==============================================================================
+
+def statistic(metric: str, s: Dict[str, List[float]]) -> Optional[float]:
+    if metric == "slowdown":
+        if not s["fg_ipc"] or not s["ref_ipc"] or mean(s["fg_ipc"]) <= 0:
+            return None
+        return mean(s["ref_ipc"]) / mean(s["fg_ipc"])
+    return mean(s[metric]) if s[metric] else None
+
+
+def bootstrap_once(rng: random.Random, metric: str,
+                   s: Dict[str, List[float]]) -> Optional[float]:
+    return statistic(metric, {k: resample(rng, v) if v else v for k, v in s.items()})
+
+
+def bootstrap_ci(rng: random.Random, metric: str, s: Dict[str, List[float]],
+                 resamples: int, confidence: float) -> Optional[Tuple[float, float]]:
+    dist = [bootstrap_once(rng, metric, s) for _ in range(resamples)]
+    dist = sorted(d for d in dist if d is not None)
+    if not dist:
+        return None
+    tail = (100.0 - confidence) / 2
+    return percentile(dist, tail), percentile(dist, 100.0 - tail)
+
+
+def bootstrap_diff_ci(rng: random.Random, metric: str, cur: Dict[str, List[float]],
+                      base: Dict[str, List[float]], resamples: int,
+                      confidence: float) -> Optional[Tuple[float, float]]:
+    dist = []
+    for _ in range(resamples):
+        c = bootstrap_once(rng, metric, cur)
+        b = bootstrap_once(rng, metric, base)
+        if c is not None and b is not None:
+            dist.append(c - b)
+    if not dist:
+        return None
+    dist.sort()
+    tail = (100.0 - confidence) / 2
+    return percentile(dist, tail), percentile(dist, 100.0 - tail)
+
+#==============================================================================
+# COMMANDS
+#==============================================================================
+
+def cmd_run(args: argparse.Namespace) -> int:
+    if args.runs <= 0:
+        error_exit("-n must be > 0")
+    if not os.access(args.bench, os.X_OK):
+        error_exit(f"areg-bench not found: {args.bench} (make -C tools)")
+    for i in range(args.runs):
+        print(f"=== suite iteration {i + 1}/{args.runs}", file=sys.stderr)
+        ret = subprocess.call([args.bench, args.plan, "-o", args.output])
+        if ret != 0:
+            error_exit(f"areg-bench failed ({ret})", 1)
+    return 0
+
+
+def cmd_report(args: argparse.Namespace) -> int:
+    rng = random.Random(args.seed)
+    configs = load_samples(args.results)
+    if not configs:
+        error_exit("no FG+BG runs in the results")
+
+    print(f"# configuration, metric, n, value, ci{args.confidence:g}_low, ci{args.confidence:g}_high")
+    for key in sorted(configs):
+        s = configs[key]
+        for m in METRICS:
+            v = statistic(m, s)
+            if v is None:
+                continue
+            lo, hi = bootstrap_ci(rng, m, s, args.resamples, args.confidence)
+            n = len(s["fg_ipc"] if m == "slowdown" else s[m])
+            print(f"{key}, {m}, {n}, {v:.4f}, {lo:.4f}, {hi:.4f}")
+    return 0
+
+
+def cmd_compare(args: argparse.Namespace) -> int:
+    rng = random.Random(args.seed)
+    configs = load_samples(args.results)
+    if not configs:
+        error_exit("no FG+BG runs in the results")
+
+    if args.save_baseline:
+        with open(args.baseline, "w") as f:
+            json.dump({"version": BASELINE_VERSION, "configs": configs}, f, indent=1)
+        print(f"baseline with {len(configs)} configurations written to {args.baseline}")
+        return 0
+
+    try:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+    except (OSError, ValueError) as e:
+        error_exit(f"{args.baseline}: {e} (create it with --save-baseline)")
+    if baseline.get("version") != BASELINE_VERSION:
+        error_exit(f"{args.baseline}: unsupported baseline version")
+
+    regressions = 0
+    print(f"# configuration, metric, baseline, current, change_pct, "
+          f"diff_ci{args.confidence:g}_low, diff_ci{args.confidence:g}_high, verdict")
+    for key in sorted(configs):
+        base = baseline["configs"].get(key)
+        if base is None:
+            print(f"{key}, -, -, -, -, -, -, new")
+            continue
+        for m in METRICS:
+            b = statistic(m, base)
+            c = statistic(m, configs[key])
+            if b is None or c is None:
+                continue
+            ci = bootstrap_diff_ci(rng, m, configs[key], base, args.resamples, args.confidence)
+            change = 100.0 * (c - b) / b if b else 0.0
+            if ci[0] > 0 and change >= args.min_effect:
+                verdict = "REGRESSION"
+                regressions += 1
+            elif ci[1] < 0 and -change >= args.min_effect:
+                verdict = "improved"
+            else:
+                verdict = "same"
+            print(f"{key}, {m}, {b:.4f}, {c:.4f}, {change:+.2f}, {ci[0]:+.4f}, {ci[1]:+.4f}, {verdict}")
+
+    for key in sorted(set(baseline["configs"]) - set(configs)):
+        print(f"{key}, -, -, -, -, -, -, missing")
+
+    if regressions:
+        print(f"{regressions} significant regression(s)", file=sys.stderr)
+        return 1
+    return 0
+
+#==============================================================================
+# MAIN
+#==============================================================================
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Regulator performance regression suite")
+    sub = parser.add_subparsers(dest="cmd", required=True)
+
+    p = sub.add_parser("run", help="run an areg-bench plan N times")
+    p.add_argument("plan")
+    p.add_argument("-n", "--runs", type=int, default=10)
+    p.add_argument("-o", "--output", required=True, help="JSONL results (appended)")
+    p.add_argument("--bench", default=DEFAULT_BENCH)
+    p.set_defaults(func=cmd_run)
+
+    for name, func, helptext in (("report", cmd_report, "summarise results with CIs"),
+                                 ("compare", cmd_compare, "compare results with a baseline")):
+        p = sub.add_parser(name, help=helptext)
+        p.add_argument("results")
+        p.add_argument("--resamples", type=int, default=DEFAULT_RESAMPLES)
+        p.add_argument("--confidence", type=float, default=DEFAULT_CONFIDENCE)
+        p.add_argument("--seed", type=int, default=1)
+        p.set_defaults(func=func)
+        if name == "compare":
+            p.add_argument("--baseline", required=True)
+            p.add_argument("--save-baseline", action="store_true",
+                           help="write the results as the new baseline")
+            p.add_argument("--min-effect", type=float, default=DEFAULT_MIN_EFFECT,
+                           help="smallest change in percent that counts")
+
+    args = parser.parse_args()
+    if getattr(args, "confidence", 50) <= 0 or getattr(args, "confidence", 50) >= 100:
+        error_exit("--confidence must be in (0, 100)")
+    return args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,191 +1,461 @@
 /**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
  *
- * This file is distributed under GPL v2 License. 
+ * Microbenchmark of the regulator hot paths (module t, test_makefile).
+ * Every case runs bench_iterations times on bench_cpu, each iteration
+ * timed with get_cycles() with preemption disabled, and with interrupts
+ * disabled too when bench_irqs_off is set or when the path runs with
+ * interrupts off in the regulator (the timer re-arm). Results:
+ *
+ *   cat /sys/kernel/debug/ar_bench/results     per case percentiles and
+ *                                              log2 cycle histogram
+ *   echo 1 > /sys/kernel/debug/ar_bench/run    run again, e.g. after
+ *                                              changing a parameter
+ *
+ * The same model.c, utils.c and ar_perfs.c as areg.ko are linked in, so
+ * the numbers are those of the code the regulator runs. "empty" times the
+ * harness itself (indirect call and the two get_cycles()).
+ *
+ * This file is distributed under GPL v2 License.
  * See LICENSE.TXT for details.
  *
  */
 
-
 /**************************************************************************
  * Included Files
  **************************************************************************/
-#include <linux/version.h>
-#include <linux/kernel.h>
-#include <linux/module.h>
-#include <linux/hrtimer.h>
-#include <linux/ktime.h>
-#include <linux/smp.h> /* IPI calls */
-#include <linux/irq_work.h>
-#include <linux/hardirq.h>
-#include <linux/perf_event.h>
-#include <linux/delay.h>
-#include <linux/debugfs.h>
-#include <linux/seq_file.h>
-#include <asm/atomic.h>
-#include <linux/slab.h>
-#include <linux/vmalloc.h>
-#include <linux/uaccess.h>
-#include <linux/notifier.h>
-#include <linux/kthread.h>
-#include <linux/printk.h>
-#include <linux/interrupt.h>
-#include <linux/trace_events.h>
-
-#include <linux/topology.h>
-#include <linux/kfifo.h>
-
-
-#include <linux/cpumask.h> //for CPU hotplugging
-
-
-#include <linux/init.h>
-#include <linux/hw_breakpoint.h>
-#include <linux/kstrtox.h>
-
-
-
-#if LINUX_VERSION_CODE > KERNEL_VERSION(5, 0, 0)
-#  include <uapi/linux/sched/types.h>
-#elif LINUX_VERSION_CODE > KERNEL_VERSION(4, 13, 0)
-#  include <linux/sched/types.h>
-#elif LINUX_VERSION_CODE > KERNEL_VERSION(3, 8, 0)
-#  include <linux/sched/rt.h>
-#endif
-#include <linux/sched.h>
-
-
-#include "ar_debugfs.h"
-#include "ar_perfs.h"
+#include "kernel_headers.h"
+#include <linux/random.h>
+#include <linux/sort.h>
+#include <linux/workqueue.h>
+#include <asm/timex.h>
+
 #include "ar.h"
+#include "ar_perfs.h"
+#include "ar_uapi.h"
+#include "model.h"
+#include "utils.h"
+
+/**************************************************************************
+ * Parameters
+ **************************************************************************/
+
+static unsigned int bench_cpu = 1;
+module_param(bench_cpu, uint, S_IRUSR | S_IRGRP);
+MODULE_PARM_DESC(bench_cpu, "CPU the cases and the counter run on (default 1)");
+
+static unsigned int bench_iterations = 100000;
+module_param(bench_iterations, uint, S_IRUSR | S_IWUSR | S_IRGRP);
+MODULE_PARM_DESC(bench_iterations, "Timed iterations per case");
+
+static unsigned int bench_warmup = 1000;
+module_param(bench_warmup, uint, S_IRUSR | S_IWUSR | S_IRGRP);
+MODULE_PARM_DESC(bench_warmup, "Untimed iterations per case before timing");
+
+static bool bench_irqs_off;
+module_param(bench_irqs_off, bool, S_IRUSR | S_IWUSR | S_IRGRP);
+MODULE_PARM_DESC(bench_irqs_off, "Disable interrupts around every iteration, not only the PMU re-arm");
+
+/* Same range as ar/regu_interval: the conversions divide by it */
+static int bench_interval_set(const char *val, const struct kernel_param *kp)
+{
+    unsigned int ms;
+    int ret = kstrtouint(val, 0, &ms);
+
+    if (ret)
+        return ret;
+    if (ms == 0 || ms > AREG_REGU_INTERVAL_MAX_MS)
+        return -EINVAL;
+    return param_set_uint(val, kp);
+}
+
+static const struct kernel_param_ops bench_interval_ops = {
+    .set = bench_interval_set,
+    .get = param_get_uint,
+};
+
+static unsigned int bench_interval_ms = 1;
+module_param_cb(bench_interval_ms, &bench_interval_ops, &bench_interval_ms,
+                S_IRUSR | S_IWUSR | S_IRGRP);
+MODULE_PARM_DESC(bench_interval_ms, "Regulation interval seen by the conversions (1..60000 ms)");
 
-//extern void set_cpu_online(unsigned int cpu, bool online);
+static int bench_counter_id = PMU_LLC_MISS_COUNTER_ID;
+module_param(bench_counter_id, hexint, S_IRUSR | S_IRGRP);
+MODULE_PARM_DESC(bench_counter_id, "Raw PMU event of the counter cases (default LLC misses)");
 
+/* Large enough that the counter does not overflow while being re-armed */
+#define AR_BENCH_BUDGET_MB  30000
+
+/* Upper bound of bench_iterations, 40 MB of samples */
+#define AR_BENCH_MAX_ITERATIONS 10000000
 
 /**************************************************************************
- * Function Declarations 
+ * Regulator state the cases run on
  **************************************************************************/
-void switch_off_cpu(int cpu);
-void switch_on_cpu(int cpu);
-// static wait_queue_head_t evt;
-// static u8 next_task = 0;
+
+static struct core_info ar_bench_core;
+static u64 ar_bench_budget;
+static u64 ar_bench_overflows;
+
+/* Results go here so the compiler keeps the calls */
+static u64 ar_bench_sink;
+
+/* ar_perfs.c and utils.c look these up in ar.c and ar_debugfs.c */
+struct core_info *get_core_info(u8 cpu_id)
+{
+    return &ar_bench_core;
+}
+
+u32 get_regulation_time(void)
+{
+    return READ_ONCE(bench_interval_ms);
+}
+
+static void ar_bench_overflow(struct perf_event *event,
+                              struct perf_sample_data *data,
+                              struct pt_regs *regs)
+{
+    ar_bench_overflows++;
+}
 
 /**************************************************************************
- * Callbacks and Handlers
+ * Cases
  **************************************************************************/
 
+static void ar_bench_empty(u32 i)
+{
+}
 
+static void ar_bench_estimate(u32 i)
+{
+    ar_bench_sink += estimate(ar_bench_core.read_event_hist, HIST_SIZE,
+                              ar_bench_core.weight_matrix, HIST_SIZE,
+                              i % HIST_SIZE);
+}
 
-static struct task_struct* thread_kt1 = NULL;
-
-//static int master_thread_func(void * data) {
-//    int cpu_id = 1;
-//    pr_info("%s: Enter",__func__);
-//	struct perf_event_attr attr;
-//
-//	memset(&attr, 0, sizeof(struct perf_event_attr));
-//	attr.type = PERF_TYPE_HARDWARE;
-//	attr.config = PERF_COUNT_HW_CACHE_MISSES;
-//	attr.size = sizeof(struct perf_event_attr);
-//	attr.disabled = 0;
-//	attr.exclude_kernel = 0;
-//	attr.exclude_hv = 1;
-//
-//	// Create perf event on CPU 0
-//	llc_miss_event = perf_event_create_kernel_counter(
-//		&attr, 0, NULL, NULL, NULL);
-//
-//	if (IS_ERR(llc_miss_event)) {
-//		pr_err("Failed to create perf event\n");
-//		return PTR_ERR(llc_miss_event);
-//	}
-//
-////    sched_set_fifo(current);
-//
-//    while (!kthread_should_stop() ) {
-//
-//        trace_printk("Wait for Event\n");
-////        wait_event_interruptible( evt,
-////                     cinfo->throttled_task ||
-////                     kthread_should_stop());
-////
-//        if (kthread_should_stop()){
-//        	pr_info("test: Stopping thread %s\n",__func__);
-//            break;
-//        }
-//
-////        trace_printk("Throttling...\n");
-////
-////        if (cpu_online(cpu_id)) {
-////			set_cpu_online(cpu_id,false);
-////    	    pr_info("%s: cpu down = %d \n",__func__,cpu_id, ret);
-////        }else {
-////          	int ret = cpu_up(cpu_id);
-////            pr_info("%s: cpu_up(%d) = %d \n",__func__,cpu_id, ret);
-////        }
-//        ssleep(5);
-//    }
-//
-//    pr_info("ar: %s: Exit",__func__);
-//    return 0;
-//}
-
-//
-//void switch_off_cpu(int cpu){
-//
-// if (cpu_online(cpu)) {
-//	set_cpu_online(cpu,false);
-//	pr_info("%s: cpu down = %d \n",__func__,cpu);
-// }
-//}
-//
-//void switch_on_cpu(int cpu){
-//  	set_cpu_online(cpu,true);
-//	pr_info("%s: cpu up = %d \n",__func__,cpu);
-//}
-/**************************************************************************************************************************
- * Module main
- **************************************************************************************************************************/
+/* Alternating sign keeps the weights where they started */
+static void ar_bench_update_weights(u32 i)
+{
+    update_weight_matrix((i & 1) ? -250 : 250, &ar_bench_core);
+}
+
+static void ar_bench_mb_to_events(u32 i)
+{
+    ar_bench_sink += convert_mb_to_events(1000 + (i & 1023));
+}
+
+static void ar_bench_events_to_mb(u32 i)
+{
+    ar_bench_sink += convert_events_to_mb(16384 + (i & 1023));
+}
+
+static void ar_bench_event_count(u32 i)
+{
+    ar_bench_sink += perf_event_count(ar_bench_core.read_event);
+}
+
+/* The counter re-arm of new_ar_regu_timer_callback */
+static void ar_bench_pmu_rearm(u32 i)
+{
+    struct perf_event *event = ar_bench_core.read_event;
+
+    event->pmu->stop(event, PERF_EF_UPDATE);
+    local64_set(&event->hw.period_left, ar_bench_budget);
+    event->pmu->start(event, PERF_EF_RELOAD);
+}
+
+struct ar_bench_result {
+    u32 min;
+    u32 p50;
+    u32 p99;
+    u32 p999;
+    u32 max;
+    u64 mean;
+    u64 hist[AR_LOG2_BUCKETS];  /* cycles, same buckets as ar_log2_hist */
+};
+
+struct ar_bench_case {
+    const char *name;
+    void (*fn)(u32 i);
+    bool irqs_off;      /* always, as in the regulator */
+    bool counter;       /* needs ar_bench_core.read_event */
+    bool done;
+    struct ar_bench_result res;
+};
+
+static struct ar_bench_case ar_bench_cases[] = {
+    { .name = "empty",                .fn = ar_bench_empty },
+    { .name = "estimate",             .fn = ar_bench_estimate },
+    { .name = "update_weight_matrix", .fn = ar_bench_update_weights },
+    { .name = "convert_mb_to_events", .fn = ar_bench_mb_to_events },
+    { .name = "convert_events_to_mb", .fn = ar_bench_events_to_mb },
+    { .name = "perf_event_count",     .fn = ar_bench_event_count, .counter = true },
+    { .name = "pmu_rearm",            .fn = ar_bench_pmu_rearm, .counter = true,
+      .irqs_off = true },
+};
+
+/**************************************************************************
+ * Runner
+ **************************************************************************/
+
+static DEFINE_MUTEX(ar_bench_lock);
+static u32 *ar_bench_samples;
+static u32 ar_bench_nr_samples;
+static bool ar_bench_have_counter;
+
+static u32 ar_bench_once(const struct ar_bench_case *c, u32 i, bool irqs_off)
+{
+    unsigned long flags = 0;
+    cycles_t t0, t1;
+
+    preempt_disable();
+    if (irqs_off)
+        local_irq_save(flags);
+    t0 = get_cycles();
+    c->fn(i);
+    t1 = get_cycles();
+    if (irqs_off)
+        local_irq_restore(flags);
+    preempt_enable();
+
+    return min_t(u64, t1 - t0, U32_MAX);
+}
+
+static int ar_bench_cmp(const void *a, const void *b)
+{
+    u32 x = *(const u32 *)a;
+    u32 y = *(const u32 *)b;
+
+    return (x > y) - (x < y);
+}
 
-static int __init test_init (void ){
-    
-    pr_info("ar: Supported CPUs: %d, online_cpus: %d\n", NR_CPUS, num_online_cpus());
+static u32 ar_bench_pct(u32 n, u32 permille)
+{
+    return min_t(u32, div_u64((u64)n * permille, 1000), n - 1);
+}
 
-    /* CPU0 is not hot pluggable  we use CPU 0 to run
-	    the masterthread. Also confirm  CONFIG_HOTPLUG_CPU=y
-		is enabled in the kernel  configuration
-	*/
+static void ar_bench_case_run(struct ar_bench_case *c)
+{
+    struct ar_bench_result *res = &c->res;
+    bool irqs_off = c->irqs_off || READ_ONCE(bench_irqs_off);
+    u32 n = ar_bench_nr_samples;
+    u64 sum = 0;
+    u32 i;
+
+    for (i = 0; i < READ_ONCE(bench_warmup); i++)
+        ar_bench_once(c, i, irqs_off);
+
+    for (i = 0; i < n; i++) {
+        ar_bench_samples[i] = ar_bench_once(c, i, irqs_off);
+        if ((i & 1023) == 1023)
+            cond_resched();
+    }
+
+    sort(ar_bench_samples, n, sizeof(u32), ar_bench_cmp, NULL);
+
+    memset(res, 0, sizeof(*res));
+    for (i = 0; i < n; i++) {
+        u32 v = ar_bench_samples[i];
+        u8 b = (v == 0) ? 0 : fls(v) - 1;
+
+        res->hist[min_t(u8, b, AR_LOG2_BUCKETS - 1)]++;
+        sum += v;
+    }
+    res->min = ar_bench_samples[0];
+    res->p50 = ar_bench_samples[ar_bench_pct(n, 500)];
+    res->p99 = ar_bench_samples[ar_bench_pct(n, 990)];
+    res->p999 = ar_bench_samples[ar_bench_pct(n, 999)];
+    res->max = ar_bench_samples[n - 1];
+    res->mean = div_u64(sum, n);
+    c->done = true;
+}
 
+static void ar_bench_core_init(void)
+{
+    u8 i;
 
-//    int cpu_id  = 0; //cpuid= 1,2,3 4 are reserved for BW regulation
-//    thread_kt1 = kthread_create_on_node(master_thread_func,
-//                                       (void*)NULL,
-//                                       cpu_to_node(cpu_id),
-//                                       "kcontroller/%d",cpu_id);
-//	BUG_ON(IS_ERR(thread_kt1));
-//	kthread_bind(thread_kt1, cpu_id);
-//    wake_up_process(thread_kt1);
+    ar_bench_core.cpu_id = bench_cpu;
+    ar_bench_core.ri = 0;
+    atomic_set(&ar_bench_core.throttler_task, false);
+    initialize_weight_matrix(&ar_bench_core, true);
+
+    /* A plausible history, in MB/s */
+    for (i = 0; i < HIST_SIZE; i++)
+        ar_bench_core.read_event_hist[i] = 500 + get_random_u32() % 1500;
+}
 
-    extern int estimate(void);
-    estimate();
-    pr_info("Exit");
+/* On bench_cpu, from work_on_cpu() */
+static long ar_bench_run_on_cpu(void *unused)
+{
+    int i;
 
+    ar_bench_core_init();
 
-//	switch_off_cpu(2);
+    for (i = 0; i < ARRAY_SIZE(ar_bench_cases); i++) {
+        struct ar_bench_case *c = &ar_bench_cases[i];
+
+        c->done = false;
+        if (c->counter && !ar_bench_have_counter)
+            continue;
+        ar_bench_case_run(c);
+    }
     return 0;
+}
 
+static int ar_bench_run(void)
+{
+    int ret = 0;
+
+    mutex_lock(&ar_bench_lock);
+
+    ar_bench_nr_samples = clamp_t(u32, READ_ONCE(bench_iterations), 1,
+                                  AR_BENCH_MAX_ITERATIONS);
+    vfree(ar_bench_samples);
+    ar_bench_samples = vmalloc(array_size(ar_bench_nr_samples, sizeof(u32)));
+    if (!ar_bench_samples) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    ret = work_on_cpu(bench_cpu, ar_bench_run_on_cpu, NULL);
+out:
+    mutex_unlock(&ar_bench_lock);
+    return ret;
 }
 
+/**************************************************************************
+ * debugfs
+ **************************************************************************/
 
-static void __exit test_exit( void )
-{ 
-    //Cleanup
-//	switch_on_cpu(2);
+static struct dentry *ar_bench_dir;
+
+static int ar_bench_results_show(struct seq_file *m, void *v)
+{
+    int i;
+    u8 b;
+
+    mutex_lock(&ar_bench_lock);
+
+    seq_printf(m, "# cpu %u, %u iterations, %u warmup, irqs off: %s, hist %d, interval %u ms\n",
+               bench_cpu, ar_bench_nr_samples, bench_warmup,
+               bench_irqs_off ? "all" : "pmu_rearm", HIST_SIZE, bench_interval_ms);
+    if (!ar_bench_have_counter)
+        seq_puts(m, "# no counter on bench_cpu, perf_event_count and pmu_rearm skipped\n");
+    seq_printf(m, "%-22s %10s %10s %10s %10s %10s %10s\n",
+               "cycles", "min", "p50", "p99", "p99.9", "max", "mean");
+
+    for (i = 0; i < ARRAY_SIZE(ar_bench_cases); i++) {
+        const struct ar_bench_case *c = &ar_bench_cases[i];
+
+        if (!c->done)
+            continue;
+        seq_printf(m, "%-22s %10u %10u %10u %10u %10u %10llu\n", c->name,
+                   c->res.min, c->res.p50, c->res.p99, c->res.p999,
+                   c->res.max, c->res.mean);
+    }
+
+    for (i = 0; i < ARRAY_SIZE(ar_bench_cases); i++) {
+        const struct ar_bench_case *c = &ar_bench_cases[i];
+
+        if (!c->done)
+            continue;
+        seq_printf(m, "\n%s\n", c->name);
+        for (b = 0; b < AR_LOG2_BUCKETS; b++) {
+            if (c->res.hist[b] == 0)
+                continue;
+            seq_printf(m, "    [%llu, %llu) %llu\n",
+                       b ? 1ULL << b : 0, 1ULL << (b + 1), c->res.hist[b]);
+        }
+    }
+
+    mutex_unlock(&ar_bench_lock);
+    return 0;
+}
+
+static int ar_bench_results_open(struct inode *inode, struct file *filp)
+{
+    return single_open(filp, ar_bench_results_show, NULL);
+}
+
+static const struct file_operations ar_bench_results_fops = {
+    .open       = ar_bench_results_open,
+    .read       = seq_read,
+    .llseek     = seq_lseek,
+    .release    = single_release,
+};
+
+static ssize_t ar_bench_run_write(struct file *filp, const char __user *ubuf,
+                                  size_t cnt, loff_t *ppos)
+{
+    int ret = ar_bench_run();
+
+    return ret ? ret : cnt;
+}
+
+static const struct file_operations ar_bench_run_fops = {
+    .write      = ar_bench_run_write,
+    .llseek     = noop_llseek,
+};
+
+/**************************************************************************
+ * Module main
+ **************************************************************************/
+
+static int __init test_init(void)
+{
+    int ret;
+    int i;
+
+    if (bench_cpu >= nr_cpu_ids || !cpu_online(bench_cpu)) {
+        pr_err("bench_cpu %u is not online\n", bench_cpu);
+        return -EINVAL;
+    }
+
+    /* Counter as areg.ko sets it up (counter_backend=perf|synth) */
+    ar_bench_budget = convert_mb_to_events(AR_BENCH_BUDGET_MB);
+    ar_bench_core.read_event = init_counter(bench_cpu, ar_bench_budget,
+                                            bench_counter_id, ar_bench_overflow);
+    ar_bench_have_counter = ar_bench_core.read_event != NULL;
+    if (ar_bench_have_counter)
+        enable_event(ar_bench_core.read_event);
+    else
+        pr_info("no counter on CPU%u, skipping the counter cases\n", bench_cpu);
+
+    ret = ar_bench_run();
+    if (ret) {
+        pr_err("benchmark failed: %d\n", ret);
+        goto err;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(ar_bench_cases); i++) {
+        const struct ar_bench_case *c = &ar_bench_cases[i];
+
+        if (c->done)
+            pr_info("%-22s cycles min %u p50 %u p99 %u max %u\n", c->name,
+                    c->res.min, c->res.p50, c->res.p99, c->res.max);
+    }
+
+    ar_bench_dir = debugfs_create_dir("ar_bench", NULL);
+    debugfs_create_file("results", 0444, ar_bench_dir, NULL, &ar_bench_results_fops);
+    debugfs_create_file("run", 0200, ar_bench_dir, NULL, &ar_bench_run_fops);
+    return 0;
+
+err:
+    if (ar_bench_have_counter)
+        disable_event(ar_bench_core.read_event);
+    vfree(ar_bench_samples);
+    return ret;
+}
 
-//    kthread_stop(thread_kt1);
-    
+static void __exit test_exit(void)
+{
+    debugfs_remove_recursive(ar_bench_dir);
+    if (ar_bench_have_counter)
+        disable_event(ar_bench_core.read_event);
+    ar_perfs_exit();
+    vfree(ar_bench_samples);
 
-	pr_info("test: Module removed\n");
-	return;
+    pr_info("test: Module removed, %llu overflows\n", ar_bench_overflows);
 }
 
 module_init(test_init);
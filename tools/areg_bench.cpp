@@ -0,0 +1,609 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * areg-bench: co-scheduling benchmark driver. Replaces the cset/perf stat/
+ * pstree pipeline of scripts/cosch_*.sh and isol_ipc_benchmark.sh.
+ *
+ *   areg-bench PLAN [-o results.jsonl] [-j MAX_PARALLEL] [--ar-dir DIR] [-n]
+ *
+ * Every run starts its workloads pinned to their CPUs, each in its own
+ * process group, and counts them with perf_event_open (inherited by the
+ * whole process tree and enabled at exec). A run ends when the foreground
+ * exits or duration_ms elapses; the process groups are then killed and one
+ * JSON record per run is appended to the output. Runs whose CPU sets are
+ * disjoint execute concurrently.
+ *
+ * Plan file, one directive per line, '#' starts a comment:
+ *   duration_ms N        run time limit (default 10000)
+ *   repeat N             run every listed run N times (default 1)
+ *   cooldown_ms N        idle time of a CPU between two runs (default 0)
+ *   ar FILE VALUE        write VALUE to DIR/FILE (default dir /sys/kernel/debug/ar)
+ *   run NAME | CPU | CMD [| CPU | CMD ...]
+ *                        first workload is the foreground, the rest background;
+ *                        CMD is run by /bin/sh -c
+ * `ar` lines after a `run` start a new batch: the batch before completes,
+ * then the settings are written, so one plan can compare configurations.
+ *
+ * Counted per workload: instructions, cycles, LLC load/store misses and,
+ * when the module is loaded, areg/throttled_ns and areg/overflows.
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <fstream>
+#include <linux/perf_event.h>
+#include <mutex>
+#include <sched.h>
+#include <set>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const char *kDefaultArDir = "/sys/kernel/debug/ar";
+const char *kArPmuType = "/sys/bus/event_source/devices/areg/type";
+
+/* attr.config of the areg PMU events, see ar_pmu.h */
+constexpr uint64_t kArPmuThrottledNs = 0;
+constexpr uint64_t kArPmuOverflows = 1;
+
+struct Workload {
+    int cpu;
+    std::string cmd;
+};
+
+struct Run {
+    std::string name;
+    std::vector<Workload> workloads; /* [0] is the foreground */
+    int64_t duration_ms;
+    int repeat;
+};
+
+struct Batch {
+    std::vector<std::pair<std::string, std::string>> settings;
+    std::vector<Run> runs;
+};
+
+struct Plan {
+    std::vector<Batch> batches;
+    int64_t cooldown_ms = 0;
+};
+
+struct Args {
+    std::string plan;
+    std::string output;
+    std::string ar_dir = kDefaultArDir;
+    unsigned jobs = 0; /* 0: as many as the CPU sets allow */
+    bool dry_run = false;
+};
+
+void usage()
+{
+    std::fprintf(stderr,
+                 "usage: areg-bench PLAN [-o results.jsonl] [-j MAX_PARALLEL] [--ar-dir DIR] [-n]\n");
+    std::exit(2);
+}
+
+Args parse(int argc, char **argv)
+{
+    Args a;
+    for (int i = 1; i < argc; i++) {
+        std::string s = argv[i];
+        auto next = [&]() -> std::string {
+            if (++i >= argc)
+                usage();
+            return argv[i];
+        };
+        if (s == "-o")
+            a.output = next();
+        else if (s == "-j")
+            a.jobs = std::strtoul(next().c_str(), nullptr, 0);
+        else if (s == "--ar-dir")
+            a.ar_dir = next();
+        else if (s == "-n")
+            a.dry_run = true;
+        else if (!s.empty() && s[0] != '-' && a.plan.empty())
+            a.plan = s;
+        else
+            usage();
+    }
+    if (a.plan.empty())
+        usage();
+    return a;
+}
+
+int64_t now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+std::string trim(const std::string &s)
+{
+    size_t b = s.find_first_not_of(" \t\r\n");
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return b == std::string::npos ? "" : s.substr(b, e - b + 1);
+}
+
+[[noreturn]] void plan_error(const std::string &path, int line, const std::string &msg)
+{
+    std::fprintf(stderr, "%s:%d: %s\n", path.c_str(), line, msg.c_str());
+    std::exit(2);
+}
+
+Plan load_plan(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in) {
+        std::perror(path.c_str());
+        std::exit(1);
+    }
+
+    Plan p;
+    int64_t duration_ms = 10000;
+    int repeat = 1;
+    std::string raw;
+    int line = 0;
+
+    p.batches.emplace_back();
+    while (std::getline(in, raw)) {
+        line++;
+        std::string l = trim(raw.substr(0, raw.find('#')));
+        if (l.empty())
+            continue;
+
+        size_t sp = l.find_first_of(" \t");
+        std::string key = l.substr(0, sp);
+        std::string rest = sp == std::string::npos ? "" : trim(l.substr(sp));
+
+        if (key == "duration_ms") {
+            duration_ms = std::atoll(rest.c_str());
+            if (duration_ms <= 0)
+                plan_error(path, line, "duration_ms must be > 0");
+        } else if (key == "repeat") {
+            repeat = std::atoi(rest.c_str());
+            if (repeat <= 0)
+                plan_error(path, line, "repeat must be > 0");
+        } else if (key == "cooldown_ms") {
+            p.cooldown_ms = std::atoll(rest.c_str());
+        } else if (key == "ar") {
+            size_t v = rest.find_first_of(" \t");
+            if (v == std::string::npos)
+                plan_error(path, line, "expected: ar FILE VALUE");
+            if (!p.batches.back().runs.empty())
+                p.batches.emplace_back();
+            p.batches.back().settings.emplace_back(rest.substr(0, v), trim(rest.substr(v)));
+        } else if (key == "run") {
+            std::vector<std::string> f;
+            size_t start = 0;
+            for (;;) {
+                size_t bar = rest.find('|', start);
+                f.push_back(trim(rest.substr(start, bar - start)));
+                if (bar == std::string::npos)
+                    break;
+                start = bar + 1;
+            }
+            if (f.size() < 3 || f.size() % 2 == 0 || f[0].empty())
+                plan_error(path, line, "expected: run NAME | CPU | CMD [| CPU | CMD ...]");
+
+            Run r{f[0], {}, duration_ms, repeat};
+            std::set<int> cpus;
+            for (size_t i = 1; i < f.size(); i += 2) {
+                int cpu = std::atoi(f[i].c_str());
+                if (f[i].empty() || cpu < 0 || f[i + 1].empty() || !cpus.insert(cpu).second)
+                    plan_error(path, line, "bad or duplicate CPU/CMD in run " + f[0]);
+                r.workloads.push_back({cpu, f[i + 1]});
+            }
+            p.batches.back().runs.push_back(r);
+        } else {
+            plan_error(path, line, "unknown directive " + key);
+        }
+    }
+    return p;
+}
+
+/**************************************************************************
+ * Module control
+ **************************************************************************/
+
+bool ar_write(const std::string &dir, const std::string &file, const std::string &value)
+{
+    std::string path = dir + "/" + file;
+    std::ofstream out(path);
+    out << value << "\n";
+    out.flush();
+    if (!out) {
+        std::fprintf(stderr, "areg-bench: cannot write '%s' to %s\n", value.c_str(), path.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**************************************************************************
+ * Counters
+ **************************************************************************/
+
+struct CounterSpec {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+};
+
+std::vector<CounterSpec> counter_specs()
+{
+    auto cache = [](uint64_t op) {
+        return PERF_COUNT_HW_CACHE_LL | (op << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    };
+    std::vector<CounterSpec> specs = {
+        {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {"llc_load_misses", PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_OP_READ)},
+        {"llc_store_misses", PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_OP_WRITE)},
+    };
+
+    std::ifstream in(kArPmuType);
+    uint32_t type;
+    if (in >> type) {
+        specs.push_back({"throttled_ns", type, kArPmuThrottledNs});
+        specs.push_back({"overflows", type, kArPmuOverflows});
+    }
+    return specs;
+}
+
+/* Counts @pid and all its descendants from its next exec on; -1 if unsupported */
+int open_counter(const CounterSpec &spec, pid_t pid)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = spec.type;
+    attr.config = spec.config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.enable_on_exec = 1;
+    /* The areg PMU rejects any exclude_* flag (PERF_PMU_CAP_NO_EXCLUDE) */
+    attr.exclude_hv = spec.type == PERF_TYPE_HARDWARE || spec.type == PERF_TYPE_HW_CACHE;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+/* Count scaled for multiplexing; -1 if not available */
+int64_t read_counter(int fd)
+{
+    uint64_t v[3];
+    if (fd < 0 || read(fd, v, sizeof(v)) != sizeof(v) || v[2] == 0)
+        return -1;
+    return v[2] == v[1] ? v[0] : static_cast<int64_t>(static_cast<double>(v[0]) * v[1] / v[2]);
+}
+
+/**************************************************************************
+ * Runs
+ **************************************************************************/
+
+struct WorkloadResult {
+    pid_t pid = -1;
+    int gate[2] = {-1, -1};
+    std::vector<int> fds;
+    std::vector<int64_t> counts;
+    int exit_status = -1; /* -1: killed at the end of the run */
+};
+
+struct RunResult {
+    int64_t start_ns = 0;
+    int64_t elapsed_ns = 0;
+    bool timed_out = false;
+    std::vector<WorkloadResult> w;
+};
+
+/* Pin, detach into a process group and wait on the gate before the exec */
+pid_t spawn(const Workload &wl, WorkloadResult &r)
+{
+    if (pipe2(r.gate, O_CLOEXEC))
+        return -1;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        char c;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(wl.cpu, &set);
+        setpgid(0, 0);
+        std::signal(SIGPIPE, SIG_DFL);
+        if (sched_setaffinity(0, sizeof(set), &set))
+            _exit(126);
+        close(r.gate[1]);
+        if (read(r.gate[0], &c, 1) != 1)
+            _exit(126);
+        execl("/bin/sh", "sh", "-c", wl.cmd.c_str(), static_cast<char *>(nullptr));
+        _exit(127);
+    }
+    close(r.gate[0]);
+    if (pid > 0)
+        setpgid(pid, pid);
+    return pid;
+}
+
+/* Kill the group of @r and reap its leader unless @reaped already */
+void kill_group(WorkloadResult &r, bool reaped)
+{
+    int status;
+
+    kill(-r.pid, SIGKILL);
+    if (!reaped && waitpid(r.pid, &status, 0) == r.pid && WIFEXITED(status))
+        r.exit_status = WEXITSTATUS(status); /* ended on its own */
+    /* Wait for orphans too: their counts are folded in as they exit */
+    for (int i = 0; i < 1000 && kill(-r.pid, 0) == 0; i++)
+        usleep(1000);
+}
+
+RunResult execute(const Run &run, const std::vector<CounterSpec> &specs)
+{
+    RunResult res;
+    res.w.resize(run.workloads.size());
+
+    for (size_t i = 0; i < run.workloads.size(); i++) {
+        WorkloadResult &r = res.w[i];
+        r.pid = spawn(run.workloads[i], r);
+        if (r.pid < 0) {
+            std::perror("areg-bench: fork");
+            continue;
+        }
+        for (const auto &s : specs)
+            r.fds.push_back(open_counter(s, r.pid));
+    }
+
+    /* Release all workloads together; the counters enable at their exec */
+    res.start_ns = now_ns();
+    for (auto &r : res.w) {
+        if (r.pid > 0 && write(r.gate[1], "g", 1) != 1)
+            std::perror("areg-bench: gate");
+        close(r.gate[1]);
+    }
+
+    int64_t deadline = res.start_ns + run.duration_ms * 1000000;
+    WorkloadResult &fg = res.w[0];
+    while (fg.pid > 0) {
+        int status;
+        pid_t p = waitpid(fg.pid, &status, WNOHANG);
+        if (p == fg.pid) {
+            fg.exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            break;
+        }
+        if (now_ns() >= deadline) {
+            res.timed_out = true;
+            break;
+        }
+        usleep(1000);
+    }
+    res.elapsed_ns = now_ns() - res.start_ns;
+
+    for (auto &r : res.w) {
+        if (r.pid <= 0)
+            continue;
+        kill_group(r, &r == &fg && !res.timed_out);
+        for (int fd : r.fds) {
+            r.counts.push_back(read_counter(fd));
+            if (fd >= 0)
+                close(fd);
+        }
+    }
+    return res;
+}
+
+std::string json_str(const std::string &s)
+{
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+std::string to_json(const Run &run, int rep, const Batch &batch,
+                    const std::vector<CounterSpec> &specs, const RunResult &res)
+{
+    char buf[256];
+    std::string j = "{\"run\": " + json_str(run.name);
+    std::snprintf(buf, sizeof(buf),
+                  ", \"repeat\": %d, \"start_ns\": %lld, \"elapsed_ms\": %.3f, \"timed_out\": %s",
+                  rep, static_cast<long long>(res.start_ns), res.elapsed_ns * 1e-6,
+                  res.timed_out ? "true" : "false");
+    j += buf;
+
+    j += ", \"settings\": {";
+    for (size_t i = 0; i < batch.settings.size(); i++)
+        j += (i ? ", " : "") + json_str(batch.settings[i].first) + ": " +
+             json_str(batch.settings[i].second);
+    j += "}, \"workloads\": [";
+
+    for (size_t i = 0; i < run.workloads.size(); i++) {
+        const WorkloadResult &r = res.w[i];
+        std::snprintf(buf, sizeof(buf), "%s{\"role\": \"%s\", \"cpu\": %d, \"exit\": %d, ",
+                      i ? ", " : "", i ? "bg" : "fg", run.workloads[i].cpu, r.exit_status);
+        j += buf;
+        j += "\"cmd\": " + json_str(run.workloads[i].cmd);
+
+        int64_t ins = -1, cyc = -1;
+        for (size_t c = 0; c < r.counts.size(); c++) {
+            if (r.counts[c] < 0)
+                continue;
+            std::snprintf(buf, sizeof(buf), ", \"%s\": %lld", specs[c].name,
+                          static_cast<long long>(r.counts[c]));
+            j += buf;
+            if (c == 0)
+                ins = r.counts[c];
+            if (c == 1)
+                cyc = r.counts[c];
+        }
+        if (ins >= 0 && cyc > 0) {
+            std::snprintf(buf, sizeof(buf), ", \"ipc\": %.6f", static_cast<double>(ins) / cyc);
+            j += buf;
+        }
+        j += "}";
+    }
+    return j + "]}";
+}
+
+/**************************************************************************
+ * Scheduler
+ **************************************************************************/
+
+struct Job {
+    const Run *run;
+    int rep;
+    std::set<int> cpus;
+};
+
+void run_batch(const Args &a, const Plan &plan, const Batch &batch,
+               const std::vector<CounterSpec> &specs, std::FILE *out)
+{
+    std::vector<Job> pending;
+    int max_rep = 0;
+    for (const auto &r : batch.runs)
+        max_rep = std::max(max_rep, r.repeat);
+    /* Repeat-major, so repeats of a run are spread over the batch */
+    for (int rep = 0; rep < max_rep; rep++)
+        for (const auto &r : batch.runs) {
+            if (rep >= r.repeat)
+                continue;
+            Job job{&r, rep, {}};
+            for (const auto &w : r.workloads)
+                job.cpus.insert(w.cpu);
+            pending.push_back(job);
+        }
+
+    std::mutex lock;
+    std::condition_variable done;
+    std::set<int> busy;
+    std::vector<int64_t> free_at(CPU_SETSIZE, 0);
+    unsigned running = 0;
+    std::vector<std::thread> threads;
+
+    std::unique_lock<std::mutex> guard(lock);
+    while (!pending.empty() || running) {
+        int64_t now = now_ns();
+        int64_t wake = 0;
+        auto it = pending.end();
+        if (!a.jobs || running < a.jobs) {
+            it = std::find_if(pending.begin(), pending.end(), [&](const Job &j) {
+                for (int c : j.cpus)
+                    if (busy.count(c) || c >= CPU_SETSIZE)
+                        return false;
+                return true;
+            });
+        }
+        if (it != pending.end()) {
+            for (int c : it->cpus)
+                wake = std::max(wake, free_at[c]);
+            if (wake > now) {
+                /* Cooling down; look again then or when a run finishes */
+                done.wait_for(guard, std::chrono::nanoseconds(wake - now));
+                continue;
+            }
+
+            Job job = *it;
+            pending.erase(it);
+            busy.insert(job.cpus.begin(), job.cpus.end());
+            running++;
+            threads.emplace_back([&, job]() {
+                RunResult res = execute(*job.run, specs);
+                std::string rec = to_json(*job.run, job.rep, batch, specs, res);
+
+                std::lock_guard<std::mutex> g(lock);
+                std::fprintf(out, "%s\n", rec.c_str());
+                std::fflush(out);
+                std::fprintf(stderr, "areg-bench: %s #%d done in %.1f s%s\n",
+                             job.run->name.c_str(), job.rep, res.elapsed_ns * 1e-9,
+                             res.timed_out ? " (time limit)" : "");
+                int64_t t = now_ns() + plan.cooldown_ms * 1000000;
+                for (int c : job.cpus) {
+                    busy.erase(c);
+                    free_at[c] = t;
+                }
+                running--;
+                done.notify_all();
+            });
+            continue;
+        }
+        done.wait(guard);
+    }
+    guard.unlock();
+    for (auto &t : threads)
+        t.join();
+}
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+    Args a = parse(argc, argv);
+    Plan plan = load_plan(a.plan);
+    std::vector<CounterSpec> specs = counter_specs();
+
+    /* A workload failing before its exec must not take the driver down */
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if (a.dry_run) {
+        for (size_t b = 0; b < plan.batches.size(); b++) {
+            std::printf("batch %zu\n", b);
+            for (const auto &s : plan.batches[b].settings)
+                std::printf("  ar %s = %s\n", s.first.c_str(), s.second.c_str());
+            for (const auto &r : plan.batches[b].runs) {
+                std::printf("  run %s x%d, %lld ms:", r.name.c_str(), r.repeat,
+                            static_cast<long long>(r.duration_ms));
+                for (const auto &w : r.workloads)
+                    std::printf(" [cpu %d] %s", w.cpu, w.cmd.c_str());
+                std::printf("\n");
+            }
+        }
+        std::printf("counters:");
+        for (const auto &s : specs)
+            std::printf(" %s", s.name);
+        std::printf("\n");
+        return 0;
+    }
+
+    std::FILE *out = stdout;
+    if (!a.output.empty() && !(out = std::fopen(a.output.c_str(), "a"))) {
+        std::perror(a.output.c_str());
+        return 1;
+    }
+
+    for (const auto &batch : plan.batches) {
+        for (const auto &s : batch.settings)
+            if (!ar_write(a.ar_dir, s.first, s.second))
+                return 1;
+        run_batch(a, plan, batch, specs, out);
+    }
+
+    if (out != stdout)
+        std::fclose(out);
+    return 0;
+}
@@ -0,0 +1,330 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * areg-collect: drains the per-interval samples of the areg module into a
+ * compact columnar trace (see include/areg_trace.h) and exports traces as
+ * CSV tables for the scripts/ pipeline.
+ *
+ *   areg-collect record  -o run.arc [-d seconds] [-i /sys/kernel/debug/ar/samples]
+ *   areg-collect info    run.arc
+ *   areg-collect export  run.arc [-c cpu] [--from-ms N] [--to-ms N] [-o rows.csv]
+ *   areg-collect summary run.arc [-w window_ms] [-o summary.csv]
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <limits>
+#include <map>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "../ar_uapi.h"
+#include "areg_trace.h"
+
+namespace {
+
+const char *kDefaultSamples = "/sys/kernel/debug/ar/samples";
+volatile std::sig_atomic_t g_stop = 0;
+
+void on_signal(int) { g_stop = 1; }
+
+/* Without SA_RESTART, so a blocking read() returns EINTR */
+void catch_signal(int sig, void (*handler)(int))
+{
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(sig, &sa, nullptr);
+}
+
+void on_alarm(int) {}
+
+void usage()
+{
+    std::fprintf(stderr,
+                 "usage: areg-collect record  -o FILE [-d SECONDS] [-i SAMPLES]\n"
+                 "       areg-collect info    FILE\n"
+                 "       areg-collect export  FILE [-c CPU] [--from-ms N] [--to-ms N] [-o CSV]\n"
+                 "       areg-collect summary FILE [-w WINDOW_MS] [-o CSV]\n");
+    std::exit(2);
+}
+
+struct Args {
+    std::string input;
+    std::string output;
+    std::string samples = kDefaultSamples;
+    int cpu = -1;
+    double duration_s = 0;
+    int64_t from_ms = 0;
+    int64_t to_ms = -1; /* unbounded */
+    int64_t window_ms = 1000;
+};
+
+Args parse(int argc, char **argv, int first)
+{
+    Args a;
+    for (int i = first; i < argc; i++) {
+        std::string s = argv[i];
+        auto next = [&]() -> const char * {
+            if (++i >= argc)
+                usage();
+            return argv[i];
+        };
+        if (s == "-o")
+            a.output = next();
+        else if (s == "-i")
+            a.samples = next();
+        else if (s == "-d")
+            a.duration_s = std::atof(next());
+        else if (s == "-c")
+            a.cpu = std::atoi(next());
+        else if (s == "--from-ms")
+            a.from_ms = std::atoll(next());
+        else if (s == "--to-ms")
+            a.to_ms = std::atoll(next());
+        else if (s == "-w")
+            a.window_ms = std::atoll(next());
+        else if (!s.empty() && s[0] != '-' && a.input.empty())
+            a.input = s;
+        else
+            usage();
+    }
+    return a;
+}
+
+double now_s()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+std::FILE *open_out(const std::string &path)
+{
+    if (path.empty())
+        return stdout;
+    std::FILE *f = std::fopen(path.c_str(), "w");
+    if (!f) {
+        std::perror(path.c_str());
+        std::exit(1);
+    }
+    return f;
+}
+
+/**************************************************************************
+ * record
+ **************************************************************************/
+
+int cmd_record(const Args &a)
+{
+    if (a.output.empty())
+        usage();
+
+    int fd = open(a.samples.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::perror(a.samples.c_str());
+        return 1;
+    }
+
+    catch_signal(SIGINT, on_signal);
+    catch_signal(SIGTERM, on_signal);
+
+    areg::TraceWriter w(a.output);
+    std::vector<areg_sample> buf(4096);
+    uint64_t rows = 0;
+    double t_end = a.duration_s > 0 ? now_s() + a.duration_s : 0;
+
+    /* The read blocks while no samples arrive: SIGALRM ends it at -d */
+    if (t_end > 0) {
+        itimerval it = {};
+        it.it_value.tv_sec = static_cast<time_t>(a.duration_s);
+        it.it_value.tv_usec = static_cast<suseconds_t>((a.duration_s - it.it_value.tv_sec) * 1e6);
+        if (it.it_value.tv_sec == 0 && it.it_value.tv_usec == 0)
+            it.it_value.tv_usec = 1;
+        catch_signal(SIGALRM, on_alarm);
+        setitimer(ITIMER_REAL, &it, nullptr);
+    }
+
+    while (!g_stop && (t_end == 0 || now_s() < t_end)) {
+        ssize_t n = read(fd, buf.data(), buf.size() * sizeof(areg_sample));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            std::perror("read");
+            break;
+        }
+        for (size_t i = 0; i < static_cast<size_t>(n) / sizeof(areg_sample); i++) {
+            const areg_sample &s = buf[i];
+            areg::Row r;
+            r.cpu = s.cpu;
+            r.v[areg::kColTimestampNs] = static_cast<int64_t>(s.timestamp_ns);
+            r.v[areg::kColUsedMb] = static_cast<int64_t>(s.used_mb);
+            r.v[areg::kColPredictedMb] = s.predicted_mb;
+            r.v[areg::kColBudgetMb] = static_cast<int64_t>(s.budget_mb);
+            r.v[areg::kColOverflows] = static_cast<int64_t>(s.overflows);
+            r.v[areg::kColThrottledNs] = static_cast<int64_t>(s.throttled_ns);
+            r.v[areg::kColFlags] = s.flags;
+            w.append(r);
+            rows++;
+        }
+    }
+
+    close(fd);
+    w.close();
+    std::fprintf(stderr, "%llu rows, %llu bytes (%.2f bytes/row)\n",
+                 static_cast<unsigned long long>(rows),
+                 static_cast<unsigned long long>(w.bytes_written()),
+                 rows ? static_cast<double>(w.bytes_written()) / rows : 0.0);
+    return 0;
+}
+
+/**************************************************************************
+ * info / export / summary
+ **************************************************************************/
+
+int cmd_info(const Args &a)
+{
+    areg::TraceReader r(a.input);
+    std::map<uint32_t, std::pair<uint64_t, std::pair<int64_t, int64_t>>> cores;
+
+    for (const auto &e : r.index()) {
+        auto it = cores.find(e.cpu);
+        if (it == cores.end()) {
+            cores[e.cpu] = {e.rows, {e.t_first, e.t_last}};
+            continue;
+        }
+        it->second.first += e.rows;
+        it->second.second.first = std::min(it->second.second.first, e.t_first);
+        it->second.second.second = std::max(it->second.second.second, e.t_last);
+    }
+
+    std::printf("blocks: %zu\n", r.index().size());
+    for (const auto &kv : cores)
+        std::printf("cpu %u: %llu rows over %.3f s\n", kv.first,
+                    static_cast<unsigned long long>(kv.second.first),
+                    (kv.second.second.second - kv.second.second.first) * 1e-9);
+    return 0;
+}
+
+/* First timestamp of the trace; exported times are relative to it */
+int64_t trace_origin(const areg::TraceReader &r)
+{
+    int64_t t0 = std::numeric_limits<int64_t>::max();
+    for (const auto &e : r.index())
+        t0 = std::min(t0, e.t_first);
+    return r.index().empty() ? 0 : t0;
+}
+
+int cmd_export(const Args &a)
+{
+    areg::TraceReader r(a.input);
+    int64_t t0 = trace_origin(r);
+    std::FILE *out = open_out(a.output);
+
+    std::fprintf(out, "# cpu");
+    for (unsigned c = 0; c < areg::kNumColumns; c++)
+        std::fprintf(out, ", %s", areg::kColumnNames[c]);
+    std::fprintf(out, "\n");
+
+    int64_t t_to = a.to_ms < 0 ? std::numeric_limits<int64_t>::max() : t0 + a.to_ms * 1000000;
+
+    r.scan(a.cpu, t0 + a.from_ms * 1000000, t_to, [&](const areg::Row &row) {
+        std::fprintf(out, "%u, %lld", row.cpu, static_cast<long long>(row.v[0] - t0));
+        for (unsigned c = 1; c < areg::kNumColumns; c++)
+            std::fprintf(out, ", %lld", static_cast<long long>(row.v[c]));
+        std::fprintf(out, "\n");
+    });
+
+    if (out != stdout)
+        std::fclose(out);
+    return 0;
+}
+
+struct Window {
+    uint64_t n = 0;
+    double used = 0, predicted = 0, budget = 0;
+    int64_t overflows_first = 0, overflows_last = 0;
+    int64_t throttled_first = 0, throttled_last = 0;
+};
+
+int cmd_summary(const Args &a)
+{
+    if (a.window_ms <= 0)
+        usage();
+
+    areg::TraceReader r(a.input);
+    int64_t t0 = trace_origin(r);
+    int64_t win_ns = a.window_ms * 1000000;
+    std::map<std::pair<uint32_t, int64_t>, Window> wins;
+
+    r.scan(-1, std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max(),
+           [&](const areg::Row &row) {
+               Window &w = wins[{row.cpu, (row.v[areg::kColTimestampNs] - t0) / win_ns}];
+               if (w.n == 0) {
+                   w.overflows_first = row.v[areg::kColOverflows];
+                   w.throttled_first = row.v[areg::kColThrottledNs];
+               }
+               w.n++;
+               w.used += row.v[areg::kColUsedMb];
+               w.predicted += row.v[areg::kColPredictedMb];
+               w.budget += row.v[areg::kColBudgetMb];
+               w.overflows_last = row.v[areg::kColOverflows];
+               w.throttled_last = row.v[areg::kColThrottledNs];
+           });
+
+    std::FILE *out = open_out(a.output);
+    std::fprintf(out, "# cpu, window_start_ms, samples, used_mb, predicted_mb, budget_mb, "
+                      "overflows, throttled_ms, throttled_pct\n");
+    for (const auto &kv : wins) {
+        const Window &w = kv.second;
+        double throttled_ms = (w.throttled_last - w.throttled_first) * 1e-6;
+        std::fprintf(out, "%u, %lld, %llu, %.1f, %.1f, %.1f, %lld, %.3f, %.3f\n", kv.first.first,
+                     static_cast<long long>(kv.first.second * a.window_ms),
+                     static_cast<unsigned long long>(w.n), w.used / w.n, w.predicted / w.n,
+                     w.budget / w.n, static_cast<long long>(w.overflows_last - w.overflows_first),
+                     throttled_ms, 100.0 * throttled_ms / a.window_ms);
+    }
+
+    if (out != stdout)
+        std::fclose(out);
+    return 0;
+}
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+        usage();
+
+    std::string cmd = argv[1];
+    Args a = parse(argc, argv, 2);
+
+    try {
+        if (cmd == "record")
+            return cmd_record(a);
+        if (a.input.empty())
+            usage();
+        if (cmd == "info")
+            return cmd_info(a);
+        if (cmd == "export")
+            return cmd_export(a);
+        if (cmd == "summary")
+            return cmd_summary(a);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "areg-collect: %s\n", e.what());
+        return 1;
+    }
+    usage();
+}
@@ -0,0 +1,373 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * areg-load: controllable memory bandwidth aggressor. One thread per listed
+ * CPU, pinned, each walking its own buffer (larger than the LLC) with one
+ * of the access patterns below at a target rate, and recording the bytes
+ * it touched in every 1 ms slot.
+ *
+ *   areg-load -c CPUS [-p PATTERN] [-r MB/S] [-s SIZE_MB] [-d SECONDS]
+ *             [--phases MS:MB[,MS:MB...]] [--burst PERIOD_MS:DUTY_PCT:MB]
+ *             [-o per_ms.csv]
+ *
+ *   PATTERN  read    streaming loads, one per cache line (default)
+ *            write   streaming stores; DRAM sees ~2x (RFO + write-back)
+ *            random  loads of random cache lines
+ *            chase   dependent loads along a random cyclic chain
+ *
+ * The target rate of a slot is the current --phases entry (the schedule
+ * repeats; -r when there is none), plus the --burst MB during the first
+ * DUTY_PCT of every PERIOD_MS. A rate of 0 means unthrottled. Within a
+ * slot the thread runs 4 KB chunks until the slot's byte budget is met and
+ * then spins to the next slot, so the core stays busy but quiet, which is
+ * what a regulated core looks like to the throttler.
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr size_t kLine = 64;
+constexpr size_t kChunkLines = 64; /* 4 KB between two pacing checks */
+
+enum class Pattern { kRead, kWrite, kRandom, kChase };
+
+struct Phase {
+    int64_t ms;
+    uint64_t mb;
+};
+
+struct Args {
+    std::vector<int> cpus;
+    Pattern pattern = Pattern::kRead;
+    uint64_t rate_mb = 0;
+    size_t size_mb = 256;
+    double duration_s = 10;
+    std::vector<Phase> phases;
+    int64_t burst_period_ms = 0;
+    int64_t burst_duty_pct = 0;
+    uint64_t burst_mb = 0;
+    std::string output;
+};
+
+void usage()
+{
+    std::fprintf(stderr,
+                 "usage: areg-load -c CPUS [-p read|write|random|chase] [-r MB/S] [-s SIZE_MB]\n"
+                 "                 [-d SECONDS] [--phases MS:MB[,MS:MB...]]\n"
+                 "                 [--burst PERIOD_MS:DUTY_PCT:MB] [-o CSV]\n");
+    std::exit(2);
+}
+
+std::vector<std::string> split(const std::string &s, char sep)
+{
+    std::vector<std::string> out;
+    size_t start = 0;
+    for (;;) {
+        size_t end = s.find(sep, start);
+        out.push_back(s.substr(start, end - start));
+        if (end == std::string::npos)
+            return out;
+        start = end + 1;
+    }
+}
+
+/* "1,2,4-6" */
+std::vector<int> parse_cpus(const std::string &s)
+{
+    std::vector<int> cpus;
+    for (const auto &tok : split(s, ',')) {
+        auto range = split(tok, '-');
+        int lo = std::atoi(range[0].c_str());
+        int hi = range.size() > 1 ? std::atoi(range[1].c_str()) : lo;
+        if (lo < 0 || hi < lo)
+            usage();
+        for (int c = lo; c <= hi; c++)
+            cpus.push_back(c);
+    }
+    return cpus;
+}
+
+Args parse(int argc, char **argv)
+{
+    Args a;
+    for (int i = 1; i < argc; i++) {
+        std::string s = argv[i];
+        auto next = [&]() -> std::string {
+            if (++i >= argc)
+                usage();
+            return argv[i];
+        };
+        if (s == "-c") {
+            a.cpus = parse_cpus(next());
+        } else if (s == "-p") {
+            std::string p = next();
+            if (p == "read")
+                a.pattern = Pattern::kRead;
+            else if (p == "write")
+                a.pattern = Pattern::kWrite;
+            else if (p == "random")
+                a.pattern = Pattern::kRandom;
+            else if (p == "chase")
+                a.pattern = Pattern::kChase;
+            else
+                usage();
+        } else if (s == "-r") {
+            a.rate_mb = std::strtoull(next().c_str(), nullptr, 0);
+        } else if (s == "-s") {
+            a.size_mb = std::strtoull(next().c_str(), nullptr, 0);
+        } else if (s == "-d") {
+            a.duration_s = std::atof(next().c_str());
+        } else if (s == "--phases") {
+            for (const auto &tok : split(next(), ',')) {
+                auto f = split(tok, ':');
+                if (f.size() != 2)
+                    usage();
+                a.phases.push_back({std::atoll(f[0].c_str()),
+                                    std::strtoull(f[1].c_str(), nullptr, 0)});
+                if (a.phases.back().ms <= 0)
+                    usage();
+            }
+        } else if (s == "--burst") {
+            auto f = split(next(), ':');
+            if (f.size() != 3)
+                usage();
+            a.burst_period_ms = std::atoll(f[0].c_str());
+            a.burst_duty_pct = std::atoll(f[1].c_str());
+            a.burst_mb = std::strtoull(f[2].c_str(), nullptr, 0);
+            if (a.burst_period_ms <= 0)
+                usage();
+        } else if (s == "-o") {
+            a.output = next();
+        } else {
+            usage();
+        }
+    }
+    if (a.cpus.empty() || a.size_mb == 0 || a.duration_s < 0.001)
+        usage();
+    return a;
+}
+
+int64_t now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Target MB/s of slot t_ms; 0 = unthrottled */
+uint64_t target_mb(const Args &a, int64_t t_ms)
+{
+    uint64_t mb = a.rate_mb;
+
+    if (!a.phases.empty()) {
+        int64_t total = 0;
+        for (const auto &p : a.phases)
+            total += p.ms;
+        int64_t t = t_ms % total;
+        for (const auto &p : a.phases) {
+            if (t < p.ms) {
+                mb = p.mb;
+                break;
+            }
+            t -= p.ms;
+        }
+    }
+    if (a.burst_mb && (t_ms % a.burst_period_ms) * 100 < a.burst_period_ms * a.burst_duty_pct)
+        mb += a.burst_mb;
+    return mb;
+}
+
+/**************************************************************************
+ * Worker
+ **************************************************************************/
+
+struct Worker {
+    int cpu;
+    std::vector<uint64_t> bytes; /* per 1 ms slot */
+    uint64_t sink = 0;
+    int error = 0;
+};
+
+struct Buffer {
+    uint8_t *base = nullptr;
+    size_t lines = 0;
+
+    explicit Buffer(size_t size_mb)
+    {
+        lines = size_mb * 1024 * 1024 / kLine;
+        base = static_cast<uint8_t *>(std::aligned_alloc(kLine, lines * kLine));
+    }
+    ~Buffer() { std::free(base); }
+
+    uint64_t *line(size_t i) { return reinterpret_cast<uint64_t *>(base + i * kLine); }
+};
+
+/* Store the index of the next line in the first word of every line */
+void build_chain(Buffer &buf, uint64_t seed)
+{
+    std::vector<uint64_t> perm(buf.lines);
+    for (size_t i = 0; i < buf.lines; i++)
+        perm[i] = i;
+    for (size_t i = buf.lines - 1; i > 0; i--) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        std::swap(perm[i], perm[seed % (i + 1)]);
+    }
+    for (size_t i = 0; i < buf.lines; i++)
+        *buf.line(perm[i]) = perm[(i + 1) % buf.lines];
+}
+
+void run_worker(const Args &a, Worker &w, std::atomic<int> &ready, std::atomic<int64_t> &t0)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(w.cpu, &set);
+    w.error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    /* Allocate and fault in after pinning so the pages are node-local */
+    Buffer buf(a.size_mb);
+    if (!buf.base && !w.error)
+        w.error = ENOMEM;
+    if (!w.error) {
+        std::memset(buf.base, 0, buf.lines * kLine);
+        if (a.pattern == Pattern::kChase)
+            build_chain(buf, 0x9e3779b97f4a7c15ULL ^ w.cpu);
+    }
+
+    ready.fetch_add(1);
+    while (t0.load() == 0)
+        ;
+    if (w.error)
+        return;
+
+    int64_t start = t0.load();
+    size_t slots = w.bytes.size();
+    size_t pos = 0;
+    uint64_t rnd = 0x2545f4914f6cdd1dULL ^ w.cpu;
+    uint64_t acc = 0;
+
+    for (;;) {
+        int64_t t = now_ns() - start;
+        size_t slot = t / 1000000;
+        if (slot >= slots)
+            break;
+
+        uint64_t rate = target_mb(a, slot);
+        uint64_t budget = rate * 1024 * 1024 / 1000;
+        if (rate && w.bytes[slot] >= budget) {
+            /* Slot budget met: spin without touching memory */
+            while ((now_ns() - start) / 1000000 == static_cast<int64_t>(slot))
+                ;
+            continue;
+        }
+
+        switch (a.pattern) {
+        case Pattern::kRead:
+            for (size_t i = 0; i < kChunkLines; i++, pos = pos + 1 == buf.lines ? 0 : pos + 1)
+                acc += *buf.line(pos);
+            break;
+        case Pattern::kWrite:
+            for (size_t i = 0; i < kChunkLines; i++, pos = pos + 1 == buf.lines ? 0 : pos + 1)
+                *buf.line(pos) = acc++;
+            break;
+        case Pattern::kRandom:
+            for (size_t i = 0; i < kChunkLines; i++) {
+                rnd ^= rnd << 13;
+                rnd ^= rnd >> 7;
+                rnd ^= rnd << 17;
+                acc += *buf.line(rnd % buf.lines);
+            }
+            break;
+        case Pattern::kChase:
+            for (size_t i = 0; i < kChunkLines; i++)
+                pos = *buf.line(pos);
+            acc += pos;
+            break;
+        }
+        w.bytes[slot] += kChunkLines * kLine;
+    }
+    w.sink = acc;
+}
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+    Args a = parse(argc, argv);
+    size_t slots = static_cast<size_t>(a.duration_s * 1000);
+
+    std::vector<Worker> workers(a.cpus.size());
+    std::vector<std::thread> threads;
+    std::atomic<int> ready{0};
+    std::atomic<int64_t> t0{0};
+
+    for (size_t i = 0; i < a.cpus.size(); i++) {
+        workers[i].cpu = a.cpus[i];
+        workers[i].bytes.assign(slots, 0);
+        threads.emplace_back(run_worker, std::cref(a), std::ref(workers[i]), std::ref(ready),
+                             std::ref(t0));
+    }
+
+    /* Start all threads on the same slot boundary */
+    while (ready.load() != static_cast<int>(workers.size()))
+        std::this_thread::yield();
+    t0.store(now_ns());
+    for (auto &t : threads)
+        t.join();
+
+    int ret = 0;
+    for (const auto &w : workers) {
+        if (w.error) {
+            std::fprintf(stderr, "areg-load: cpu %d: %s\n", w.cpu, std::strerror(w.error));
+            ret = 1;
+        }
+    }
+    if (ret)
+        return ret;
+
+    if (!a.output.empty()) {
+        std::FILE *out = std::fopen(a.output.c_str(), "w");
+        if (!out) {
+            std::perror(a.output.c_str());
+            return 1;
+        }
+        std::fprintf(out, "# t_ms, cpu, target_mb, achieved_mb\n");
+        for (size_t s = 0; s < slots; s++)
+            for (const auto &w : workers)
+                std::fprintf(out, "%zu, %d, %llu, %.1f\n", s, w.cpu,
+                             static_cast<unsigned long long>(target_mb(a, s)),
+                             w.bytes[s] * 1000.0 / (1024 * 1024));
+        std::fclose(out);
+    }
+
+    std::fprintf(stderr, "# cpu, mean_mb, min_mb, max_mb (per 1 ms slot)\n");
+    for (const auto &w : workers) {
+        uint64_t total = 0, lo = UINT64_MAX, hi = 0;
+        for (uint64_t b : w.bytes) {
+            total += b;
+            lo = std::min(lo, b);
+            hi = std::max(hi, b);
+        }
+        double scale = 1000.0 / (1024 * 1024);
+        std::fprintf(stderr, "%d, %.1f, %.1f, %.1f\n", w.cpu, total * scale / slots, lo * scale,
+                     hi * scale);
+    }
+    return 0;
+}
@@ -0,0 +1,183 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * areg-replay-hN: replays recorded per-interval demand through the
+ * module's own predictor (model.c, built for userspace with HIST_SIZE=N
+ * through tools/include/ar_shim.h) and the master's budget step, and
+ * scores parameter sets. Used by scripts/areg_tune.py.
+ *
+ *   areg-replay-hN [-s SAMPLE_MS] [-w THROTTLE_WEIGHT] TRACE...  < params
+ *
+ * TRACE is an areg-collect trace (.arc, used_mb column) or a CSV whose
+ * rows are "t_ms, cpu, ..., mb" (e.g. areg-load -o). Demand traces are
+ * best recorded with ar/monitor_only=1 at regu_interval 1, so usage is not
+ * already capped by a budget.
+ *
+ * Each stdin line "lrate_ppb initial_weight_ppm interval_ms setpoint_mb"
+ * is replayed on every core of every trace. Per interval the core gets
+ * min(demand, budget); the rest of the interval is throttled time. Output,
+ * one line per input line:
+ *   hist_size lrate_ppb initial_weight_ppm interval_ms setpoint_mb
+ *   objective mispredict_pct throttled_pct
+ * with mispredict_pct = 100 * sum|demand - budget| / sum demand and
+ * objective = mispredict_pct + THROTTLE_WEIGHT * throttled_pct.
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "areg_demand.h"
+
+extern "C" {
+#include "../kernel_headers.h"
+#include "../ar.h"
+#include "../ar_uapi.h"
+#include "../model.h"
+}
+
+namespace {
+
+struct Args {
+    std::vector<std::string> traces;
+    int64_t sample_ms = 1;
+    double throttle_weight = 1.0;
+};
+
+struct Params {
+    uint32_t lrate_ppb;
+    uint32_t initial_weight_ppm;
+    int64_t interval_ms;
+    uint64_t setpoint_mb;
+};
+
+struct Score {
+    double demand = 0;
+    double abs_err = 0;
+    double throttled = 0; /* sum of throttled fractions of intervals */
+    uint64_t intervals = 0;
+};
+
+void usage()
+{
+    std::fprintf(stderr, "usage: areg-replay-h%d [-s SAMPLE_MS] [-w THROTTLE_WEIGHT] TRACE... < params\n",
+                 HIST_SIZE);
+    std::exit(2);
+}
+
+Args parse(int argc, char **argv)
+{
+    Args a;
+    for (int i = 1; i < argc; i++) {
+        std::string s = argv[i];
+        auto next = [&]() -> const char * {
+            if (++i >= argc)
+                usage();
+            return argv[i];
+        };
+        if (s == "-s")
+            a.sample_ms = std::atoll(next());
+        else if (s == "-w")
+            a.throttle_weight = std::atof(next());
+        else if (!s.empty() && s[0] != '-')
+            a.traces.push_back(s);
+        else
+            usage();
+    }
+    if (a.traces.empty() || a.sample_ms <= 0)
+        usage();
+    return a;
+}
+
+/* One core, as master_regulate_core() and the timer would have run it */
+void replay(const std::vector<double> &series, const Params &p, int64_t k, Score &sc)
+{
+    std::unique_ptr<core_info> cinfo(new core_info());
+    std::memset(cinfo.get(), 0, sizeof(core_info));
+    cinfo->cpu_id = 1;
+    cinfo->predictor = AREG_PRED_LMS;
+
+    ar_lrate_ppb = p.lrate_ppb;
+    ar_initial_weight_ppm = p.initial_weight_ppm;
+    initialize_weight_matrix(cinfo.get(), true);
+
+    /* Until the first prediction the counter is armed at the setpoint */
+    double budget = p.setpoint_mb;
+
+    for (size_t j = 0; j + k <= series.size(); j += k) {
+        double demand = 0;
+        for (int64_t i = 0; i < k; i++)
+            demand += series[j + i];
+        demand /= k;
+
+        double used = std::min(demand, budget);
+        sc.demand += demand;
+        sc.abs_err += demand > budget ? demand - budget : budget - demand;
+        if (demand > budget)
+            sc.throttled += 1.0 - budget / demand;
+        sc.intervals++;
+
+        s64 error;
+        if (model_step(cinfo.get(), static_cast<u64>(used), p.setpoint_mb, &error)) {
+            budget = static_cast<double>(cinfo->next_estimate);
+            model_advance(cinfo.get());
+        }
+    }
+}
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+    Args a = parse(argc, argv);
+    std::vector<std::vector<double>> cores;
+
+    try {
+        for (const auto &t : a.traces)
+            for (auto &series : areg::load_demand(t))
+                cores.push_back(std::move(series));
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "areg-replay: %s\n", e.what());
+        return 1;
+    }
+    if (cores.empty()) {
+        std::fprintf(stderr, "areg-replay: no samples\n");
+        return 1;
+    }
+
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        std::istringstream in(line);
+        Params p;
+        if (!(in >> p.lrate_ppb >> p.initial_weight_ppm >> p.interval_ms >> p.setpoint_mb))
+            continue;
+        if (p.interval_ms < a.sample_ms || p.interval_ms % a.sample_ms) {
+            std::fprintf(stderr, "areg-replay: interval %lld ms is not a multiple of %lld ms\n",
+                         static_cast<long long>(p.interval_ms), static_cast<long long>(a.sample_ms));
+            return 1;
+        }
+
+        Score sc;
+        for (const auto &series : cores)
+            replay(series, p, p.interval_ms / a.sample_ms, sc);
+
+        double mispredict = sc.demand > 0 ? 100.0 * sc.abs_err / sc.demand : 0;
+        double throttled = sc.intervals ? 100.0 * sc.throttled / sc.intervals : 0;
+        std::printf("%d %u %u %lld %llu %.4f %.4f %.4f\n", HIST_SIZE, p.lrate_ppb,
+                    p.initial_weight_ppm, static_cast<long long>(p.interval_ms),
+                    static_cast<unsigned long long>(p.setpoint_mb),
+                    mispredict + a.throttle_weight * throttled, mispredict, throttled);
+        std::fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,513 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * areg-sim: discrete-event simulation of N cores sharing one DRAM, driven
+ * by the regulator's own code built for userspace (model.c for the
+ * prediction, ar_budget.c for the token bucket, fair reclaim and the
+ * contention gate, through tools/include/ar_shim.h). Meant to explore
+ * core counts and policies no test box has, faster than real time.
+ *
+ *   areg-sim [-n CORES] [-d MS] [-B CAPACITY_MB] [-L IDLE_LAT_NS]
+ *            [-w CORES=WORKLOAD]... [-M CORES=MEM_FRACTION]...
+ *            [-s SETPOINT_MB] [-p lms|static|hist_max] [--max-mb MB]
+ *            [--total-mb MB] [--bucket DEPTH_PCT]
+ *            [--gate HIGH_MB:LOW_MB:HOLD[:HIGH_NS:LOW_NS]] [--monitor-only]
+ *            [--lrate-ppb N] [--initial-weight-ppm N] [--seed N] [-o CSV]
+ *
+ * CORES is "all", "N" or "A-B". WORKLOAD, the bandwidth a core would use
+ * alone at full speed:
+ *   const:MB
+ *   burst:BASE_MB:PEAK_MB:PERIOD_MS:DUTY_PCT
+ *   sine:MEAN_MB:AMPLITUDE_MB:PERIOD_MS
+ *   random:MEAN_MB:JITTER_PCT
+ *   trace:FILE        successive cores take successive series of the
+ *                     trace (.arc or CSV, see include/areg_demand.h),
+ *                     looping at the end
+ *   idle
+ * MEM_FRACTION is the share of a core's run time stalled on memory when
+ * it runs alone at the idle latency (default 0.3).
+ *
+ * Each step is one 1 ms regulation interval:
+ *   1. Every regulated core gets its budget for the interval, through the
+ *      token bucket (bytes).
+ *   2. Speeds are solved as a fixed point of a shared queue: utilisation
+ *      rho = traffic / CAPACITY, latency = IDLE_LAT / (1 - rho), speed =
+ *      1 / ((1 - m) + m * latency / IDLE_LAT). A core whose tokens run out
+ *      is throttled for the rest of the interval; traffic beyond the
+ *      capacity is scaled back.
+ *   3. The master step runs on the measured usage: model_step() per core,
+ *      optional max-min fair reclaim of --total-mb (setpoints guaranteed,
+ *      then predicted demand), then the gate.
+ * Slowdown is the work a core would have done alone and unregulated over
+ * the run divided by the work it did.
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "areg_demand.h"
+
+extern "C" {
+#include "../kernel_headers.h"
+#include "../ar.h"
+#include "../ar_uapi.h"
+#include "../model.h"
+}
+
+namespace {
+
+/* Latency at or above this utilisation is held at IDLE_LAT / (1 - kMaxRho) */
+constexpr double kMaxRho = 0.98;
+constexpr int kFixedPointIters = 24;
+
+enum class Gen { kConst, kBurst, kSine, kRandom, kTrace, kIdle };
+
+struct Workload {
+    Gen gen = Gen::kConst;
+    double a = 1000, b = 0, c = 0, d = 0;
+    const std::vector<double> *series = nullptr;
+    std::string spec = "const:1000";
+};
+
+struct Args {
+    int cores = 64;
+    int64_t duration_ms = 10000;
+    double capacity_mb = 100000;
+    double idle_lat_ns = 80;
+    uint64_t setpoint_mb = 1000;
+    uint64_t max_mb = 30000;
+    uint64_t total_mb = 0;
+    uint32_t bucket_pct = 0;
+    ar_gate_marks gate = {};
+    bool monitor_only = false;
+    uint8_t predictor = AREG_PRED_LMS;
+    uint32_t lrate_ppb = 1000;
+    uint32_t initial_weight_ppm = INITIAL_WEIGHT_PPM;
+    uint64_t seed = 1;
+    std::string output;
+    std::vector<std::pair<std::string, std::string>> workloads;
+    std::vector<std::pair<std::string, std::string>> mem_fractions;
+};
+
+struct Core {
+    Workload w;
+    double mem_frac = 0.3;
+    core_info cinfo;
+    ar_bucket bucket;
+    uint64_t budget_mb;
+    uint64_t consumed;      /* bytes since start, the "counter" */
+
+    /* Per step */
+    double demand, speed, run, traffic;
+
+    /* Totals */
+    double sum_demand = 0, sum_traffic = 0, sum_budget = 0;
+    double throttled_ms = 0, work = 0, work_alone = 0;
+};
+
+[[noreturn]] void usage()
+{
+    std::fprintf(stderr,
+                 "usage: areg-sim [-n CORES] [-d MS] [-B CAPACITY_MB] [-L IDLE_LAT_NS]\n"
+                 "                [-w CORES=WORKLOAD]... [-M CORES=MEM_FRACTION]...\n"
+                 "                [-s SETPOINT_MB] [-p lms|static|hist_max] [--max-mb MB]\n"
+                 "                [--total-mb MB] [--bucket DEPTH_PCT]\n"
+                 "                [--gate HIGH_MB:LOW_MB:HOLD[:HIGH_NS:LOW_NS]] [--monitor-only]\n"
+                 "                [--lrate-ppb N] [--initial-weight-ppm N] [--seed N] [-o CSV]\n");
+    std::exit(2);
+}
+
+std::vector<std::string> split(const std::string &s, char sep)
+{
+    std::vector<std::string> out;
+    size_t start = 0;
+    for (;;) {
+        size_t pos = s.find(sep, start);
+        out.push_back(s.substr(start, pos - start));
+        if (pos == std::string::npos)
+            return out;
+        start = pos + 1;
+    }
+}
+
+std::pair<std::string, std::string> assignment(const std::string &s)
+{
+    size_t eq = s.find('=');
+    if (eq == std::string::npos)
+        usage();
+    return {s.substr(0, eq), s.substr(eq + 1)};
+}
+
+Args parse(int argc, char **argv)
+{
+    Args a;
+    for (int i = 1; i < argc; i++) {
+        std::string s = argv[i];
+        auto next = [&]() -> std::string {
+            if (++i >= argc)
+                usage();
+            return argv[i];
+        };
+        if (s == "-n") {
+            a.cores = std::atoi(next().c_str());
+        } else if (s == "-d") {
+            a.duration_ms = std::atoll(next().c_str());
+        } else if (s == "-B") {
+            a.capacity_mb = std::atof(next().c_str());
+        } else if (s == "-L") {
+            a.idle_lat_ns = std::atof(next().c_str());
+        } else if (s == "-w") {
+            a.workloads.push_back(assignment(next()));
+        } else if (s == "-M") {
+            a.mem_fractions.push_back(assignment(next()));
+        } else if (s == "-s") {
+            a.setpoint_mb = std::strtoull(next().c_str(), nullptr, 0);
+        } else if (s == "-p") {
+            std::string p = next();
+            if (p == "lms")
+                a.predictor = AREG_PRED_LMS;
+            else if (p == "static")
+                a.predictor = AREG_PRED_STATIC;
+            else if (p == "hist_max")
+                a.predictor = AREG_PRED_HIST_MAX;
+            else
+                usage();
+        } else if (s == "--max-mb") {
+            a.max_mb = std::strtoull(next().c_str(), nullptr, 0);
+        } else if (s == "--total-mb") {
+            a.total_mb = std::strtoull(next().c_str(), nullptr, 0);
+        } else if (s == "--bucket") {
+            a.bucket_pct = std::strtoul(next().c_str(), nullptr, 0);
+        } else if (s == "--gate") {
+            auto f = split(next(), ':');
+            if (f.size() != 3 && f.size() != 5)
+                usage();
+            a.gate.high_mb = std::strtoull(f[0].c_str(), nullptr, 0);
+            a.gate.low_mb = std::strtoull(f[1].c_str(), nullptr, 0);
+            a.gate.hold = std::strtoul(f[2].c_str(), nullptr, 0);
+            if (f.size() == 5) {
+                a.gate.high_lat_ns = std::strtoull(f[3].c_str(), nullptr, 0);
+                a.gate.low_lat_ns = std::strtoull(f[4].c_str(), nullptr, 0);
+            }
+        } else if (s == "--monitor-only") {
+            a.monitor_only = true;
+        } else if (s == "--lrate-ppb") {
+            a.lrate_ppb = std::strtoul(next().c_str(), nullptr, 0);
+        } else if (s == "--initial-weight-ppm") {
+            a.initial_weight_ppm = std::strtoul(next().c_str(), nullptr, 0);
+        } else if (s == "--seed") {
+            a.seed = std::strtoull(next().c_str(), nullptr, 0);
+        } else if (s == "-o") {
+            a.output = next();
+        } else {
+            usage();
+        }
+    }
+    if (a.cores <= 0 || a.duration_ms <= 0 || a.capacity_mb <= 0 || a.idle_lat_ns <= 0)
+        usage();
+    return a;
+}
+
+/* Cores [first, last] named by "all", "N" or "A-B" */
+std::pair<int, int> core_range(const std::string &s, int cores)
+{
+    if (s == "all")
+        return {0, cores - 1};
+    auto f = split(s, '-');
+    int first = std::atoi(f[0].c_str());
+    int last = f.size() > 1 ? std::atoi(f[1].c_str()) : first;
+    if (f.size() > 2 || first < 0 || last < first || last >= cores) {
+        std::fprintf(stderr, "areg-sim: bad core range %s for %d cores\n", s.c_str(), cores);
+        std::exit(2);
+    }
+    return {first, last};
+}
+
+Workload parse_workload(const std::string &spec, const std::vector<double> *series)
+{
+    auto f = split(spec, ':');
+    Workload w;
+    w.spec = spec;
+    auto num = [&](size_t i) { return i < f.size() ? std::atof(f[i].c_str()) : 0.0; };
+
+    if (f[0] == "const" && f.size() == 2) {
+        w.gen = Gen::kConst;
+    } else if (f[0] == "burst" && f.size() == 5) {
+        w.gen = Gen::kBurst;
+    } else if (f[0] == "sine" && f.size() == 4) {
+        w.gen = Gen::kSine;
+    } else if (f[0] == "random" && f.size() == 3) {
+        w.gen = Gen::kRandom;
+    } else if (f[0] == "trace" && series) {
+        w.gen = Gen::kTrace;
+        w.series = series;
+        return w;
+    } else if (f[0] == "idle" && f.size() == 1) {
+        w.gen = Gen::kIdle;
+        return w;
+    } else {
+        std::fprintf(stderr, "areg-sim: bad workload %s\n", spec.c_str());
+        std::exit(2);
+    }
+    w.a = num(1);
+    w.b = num(2);
+    w.c = num(3);
+    w.d = num(4);
+    return w;
+}
+
+double demand_at(const Workload &w, int64_t t, std::mt19937_64 &rng)
+{
+    switch (w.gen) {
+    case Gen::kConst:
+        return w.a;
+    case Gen::kBurst: {
+        int64_t period = std::max<int64_t>(static_cast<int64_t>(w.c), 1);
+        return (t % period) * 100 < w.d * period ? w.b : w.a;
+    }
+    case Gen::kSine:
+        return std::max(0.0, w.a + w.b * std::sin(2 * M_PI * t / std::max(w.c, 1.0)));
+    case Gen::kRandom: {
+        std::uniform_real_distribution<double> jitter(-w.b / 100, w.b / 100);
+        return std::max(0.0, w.a * (1 + jitter(rng)));
+    }
+    case Gen::kTrace:
+        return w.series->empty() ? 0 : (*w.series)[t % w.series->size()];
+    case Gen::kIdle:
+        break;
+    }
+    return 0;
+}
+
+double latency_factor(double traffic_mb, double capacity_mb)
+{
+    return 1.0 / (1.0 - std::min(traffic_mb / capacity_mb, kMaxRho));
+}
+
+double speed_at(double mem_frac, double lat_factor)
+{
+    return 1.0 / ((1.0 - mem_frac) + mem_frac * lat_factor);
+}
+
+/* Speed of a core running alone, unregulated */
+double alone_speed(const Core &c, double capacity_mb)
+{
+    double s = 1;
+    for (int k = 0; k < kFixedPointIters; k++)
+        s = 0.5 * s + 0.5 * speed_at(c.mem_frac, latency_factor(c.demand * s, capacity_mb));
+    return s;
+}
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+    Args a = parse(argc, argv);
+    std::vector<std::unique_ptr<Core>> cores;
+    std::vector<std::vector<double>> series_store;
+    std::mt19937_64 rng(a.seed);
+
+    ar_lrate_ppb = a.lrate_ppb;
+    ar_initial_weight_ppm = a.initial_weight_ppm;
+
+    for (int i = 0; i < a.cores; i++) {
+        auto c = std::make_unique<Core>();
+        std::memset(&c->cinfo, 0, sizeof(c->cinfo));
+        c->cinfo.cpu_id = 1;
+        c->cinfo.predictor = a.predictor;
+        initialize_weight_matrix(&c->cinfo, true);
+        ar_bucket_reset(&c->bucket);
+        c->budget_mb = a.setpoint_mb;
+        c->consumed = 0;
+        c->w = parse_workload("const:1000", nullptr);
+        cores.push_back(std::move(c));
+    }
+
+    /* Trace series must stay put while cores point at them */
+    size_t nseries = 0;
+    for (const auto &wl : a.workloads)
+        if (wl.second.rfind("trace:", 0) == 0)
+            nseries++;
+    series_store.reserve(nseries);
+
+    for (const auto &wl : a.workloads) {
+        auto range = core_range(wl.first, a.cores);
+        if (wl.second.rfind("trace:", 0) == 0) {
+            std::vector<std::vector<double>> per_core;
+            try {
+                per_core = areg::load_demand(wl.second.substr(6));
+            } catch (const std::exception &e) {
+                std::fprintf(stderr, "areg-sim: %s\n", e.what());
+                return 1;
+            }
+            if (per_core.empty()) {
+                std::fprintf(stderr, "areg-sim: %s: no samples\n", wl.second.c_str());
+                return 1;
+            }
+            size_t base = series_store.size();
+            for (auto &s : per_core)
+                series_store.push_back(std::move(s));
+            for (int i = range.first; i <= range.second; i++)
+                cores[i]->w = parse_workload(wl.second,
+                                             &series_store[base + (i - range.first) % per_core.size()]);
+            continue;
+        }
+        Workload w = parse_workload(wl.second, nullptr);
+        for (int i = range.first; i <= range.second; i++)
+            cores[i]->w = w;
+    }
+    for (const auto &mf : a.mem_fractions) {
+        auto range = core_range(mf.first, a.cores);
+        double m = std::atof(mf.second.c_str());
+        if (m < 0 || m > 1)
+            usage();
+        for (int i = range.first; i <= range.second; i++)
+            cores[i]->mem_frac = m;
+    }
+
+    std::FILE *out = nullptr;
+    if (!a.output.empty()) {
+        out = std::fopen(a.output.c_str(), "w");
+        if (!out) {
+            std::perror(a.output.c_str());
+            return 1;
+        }
+        std::fprintf(out, "# t_ms, core, demand_mb, used_mb, budget_mb, run_pct, latency_ns\n");
+    }
+
+    ar_gate gate = {true, 0, 0};
+    bool regulating = true;
+    std::vector<uint64_t> lo(a.cores), want(a.cores), got(a.cores);
+    double sum_traffic = 0, sum_lat = 0;
+    auto wall_start = std::chrono::steady_clock::now();
+
+    for (int64_t t = 0; t < a.duration_ms; t++) {
+        /* Interval start: demand, and tokens of the budget set last step */
+        std::vector<double> tokens(a.cores);
+        for (int i = 0; i < a.cores; i++) {
+            Core &c = *cores[i];
+            c.demand = demand_at(c.w, t, rng);
+            c.speed = 1;
+            c.run = 1;
+            /* MB/s over 1 ms is KB: bytes with MB = 1e6 */
+            tokens[i] = static_cast<double>(ar_bucket_fill(&c.bucket, c.budget_mb * 1000,
+                                                           c.consumed, a.bucket_pct));
+        }
+
+        /* Shared queue: damped fixed point of speed, throttling and latency */
+        double total = 0, lat_factor = 1;
+        for (int k = 0; k < kFixedPointIters; k++) {
+            total = 0;
+            for (int i = 0; i < a.cores; i++) {
+                Core &c = *cores[i];
+                double rate = c.demand * c.speed;       /* MB/s while running */
+                c.run = 1;
+                if (!a.monitor_only && regulating && rate > 0)
+                    c.run = std::min(1.0, tokens[i] / (rate * 1000));
+                c.traffic = rate * c.run;
+                total += c.traffic;
+            }
+            lat_factor = latency_factor(total, a.capacity_mb);
+            for (auto &c : cores)
+                c->speed = 0.5 * c->speed + 0.5 * speed_at(c->mem_frac, lat_factor);
+        }
+        if (total > a.capacity_mb) {
+            double scale = a.capacity_mb / total;
+            for (auto &c : cores) {
+                c->speed *= scale;
+                c->traffic *= scale;
+            }
+            total = a.capacity_mb;
+        }
+        double lat_ns = a.idle_lat_ns * lat_factor;
+        sum_traffic += total;
+        sum_lat += lat_ns;
+
+        /* Interval end: bookkeeping, then the master step */
+        uint64_t used_total = 0;
+        for (int i = 0; i < a.cores; i++) {
+            Core &c = *cores[i];
+            uint64_t used = static_cast<uint64_t>(c.traffic);
+
+            c.consumed += static_cast<uint64_t>(c.traffic * 1000);
+            c.sum_demand += c.demand;
+            c.sum_traffic += c.traffic;
+            c.sum_budget += c.budget_mb;
+            c.throttled_ms += 1 - c.run;
+            c.work += c.run * c.speed;
+            c.work_alone += alone_speed(c, a.capacity_mb);
+            used_total += used;
+            if (out)
+                std::fprintf(out, "%lld, %d, %.1f, %.1f, %llu, %.1f, %.1f\n",
+                             static_cast<long long>(t), i, c.demand, c.traffic,
+                             static_cast<unsigned long long>(c.budget_mb), 100 * c.run, lat_ns);
+
+            s64 error;
+            if (model_step(&c.cinfo, used, a.setpoint_mb, &error)) {
+                c.budget_mb = static_cast<uint64_t>(c.cinfo.next_estimate);
+                model_advance(&c.cinfo);
+            }
+        }
+
+        if (a.total_mb) {
+            /* One top level group: setpoints guaranteed, then demand */
+            uint64_t avail = a.total_mb;
+            for (int i = 0; i < a.cores; i++) {
+                want[i] = cores[i]->budget_mb;
+                lo[i] = std::min<uint64_t>(want[i], a.setpoint_mb);
+                got[i] = 0;
+            }
+            ar_fair_fill(got.data(), lo.data(), a.cores, &avail);
+            ar_fair_fill(got.data(), want.data(), a.cores, &avail);
+            for (int i = 0; i < a.cores; i++)
+                cores[i]->budget_mb = got[i];
+        }
+
+        regulating = ar_gate_step(&gate, &a.gate, used_total, static_cast<uint64_t>(lat_ns));
+        if (!regulating)
+            for (auto &c : cores)
+                c->budget_mb = a.max_mb;
+    }
+
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    if (out)
+        std::fclose(out);
+
+    std::printf("# simulated %lld ms of %d cores in %.3f s (%.0fx real time)\n",
+                static_cast<long long>(a.duration_ms), a.cores, wall_s,
+                a.duration_ms * 1e-3 / std::max(wall_s, 1e-9));
+    std::printf("# bandwidth %.0f MB/s (%.1f%% of %.0f), latency %.1f ns, gate transitions %llu\n",
+                sum_traffic / a.duration_ms, 100 * sum_traffic / a.duration_ms / a.capacity_mb,
+                a.capacity_mb, sum_lat / a.duration_ms,
+                static_cast<unsigned long long>(gate.transitions));
+    std::printf("# core, workload, demand_mb, used_mb, budget_mb, throttled_pct, slowdown\n");
+
+    double sum_slowdown = 0, max_slowdown = 0, sum_throttled = 0;
+    for (int i = 0; i < a.cores; i++) {
+        const Core &c = *cores[i];
+        double slowdown = c.work > 0 ? c.work_alone / c.work : INFINITY;
+        double throttled = 100 * c.throttled_ms / a.duration_ms;
+
+        sum_slowdown += slowdown;
+        max_slowdown = std::max(max_slowdown, slowdown);
+        sum_throttled += throttled;
+        std::printf("%d, %s, %.1f, %.1f, %.1f, %.2f, %.4f\n", i, c.w.spec.c_str(),
+                    c.sum_demand / a.duration_ms, c.sum_traffic / a.duration_ms,
+                    c.sum_budget / a.duration_ms, throttled, slowdown);
+    }
+    std::printf("# slowdown mean %.4f max %.4f, throttled mean %.2f%%\n",
+                sum_slowdown / a.cores, max_slowdown, sum_throttled / a.cores);
+    return 0;
+}
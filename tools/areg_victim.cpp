@@ -0,0 +1,251 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * areg-victim: latency-sensitive victim. A pinned thread issues fixed-work
+ * requests at a fixed rate (open loop) and records their latency in an
+ * HDR histogram (include/areg_hdr.h), so regulator settings can be judged
+ * by the tail latency of the foreground next to areg-load aggressors.
+ *
+ *   areg-victim -c CPU [-w hash|memcpy] [-q REQ/S] [-d SECONDS] [-t TABLE_MB]
+ *               [-n LOOKUPS] [-b BYTES] [-o latency.csv]
+ *
+ *   hash    -n lookups of random keys in an open-addressing table of -t MB
+ *   memcpy  "serialise" -b bytes from a random offset of a -t MB arena
+ *
+ * Request i is due at start + i / REQ/S. Its latency is measured from the
+ * due time, not from when it actually started, so time spent queued behind
+ * a slow (e.g. throttled) request is counted instead of omitted. The
+ * service time alone is reported too. -o writes the latency distribution.
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <vector>
+
+#include "areg_hdr.h"
+
+namespace {
+
+enum class Work { kHash, kMemcpy };
+
+struct Args {
+    int cpu = -1;
+    Work work = Work::kHash;
+    double qps = 10000;
+    double duration_s = 10;
+    size_t table_mb = 256;
+    unsigned lookups = 64;
+    size_t bytes = 64 * 1024;
+    std::string output;
+};
+
+void usage()
+{
+    std::fprintf(stderr,
+                 "usage: areg-victim -c CPU [-w hash|memcpy] [-q REQ/S] [-d SECONDS]\n"
+                 "                   [-t TABLE_MB] [-n LOOKUPS] [-b BYTES] [-o CSV]\n");
+    std::exit(2);
+}
+
+Args parse(int argc, char **argv)
+{
+    Args a;
+    for (int i = 1; i < argc; i++) {
+        std::string s = argv[i];
+        auto next = [&]() -> std::string {
+            if (++i >= argc)
+                usage();
+            return argv[i];
+        };
+        if (s == "-c") {
+            a.cpu = std::atoi(next().c_str());
+        } else if (s == "-w") {
+            std::string w = next();
+            if (w == "hash")
+                a.work = Work::kHash;
+            else if (w == "memcpy")
+                a.work = Work::kMemcpy;
+            else
+                usage();
+        } else if (s == "-q") {
+            a.qps = std::atof(next().c_str());
+        } else if (s == "-d") {
+            a.duration_s = std::atof(next().c_str());
+        } else if (s == "-t") {
+            a.table_mb = std::strtoull(next().c_str(), nullptr, 0);
+        } else if (s == "-n") {
+            a.lookups = std::strtoul(next().c_str(), nullptr, 0);
+        } else if (s == "-b") {
+            a.bytes = std::strtoull(next().c_str(), nullptr, 0);
+        } else if (s == "-o") {
+            a.output = next();
+        } else {
+            usage();
+        }
+    }
+    if (a.cpu < 0 || a.qps <= 0 || a.duration_s <= 0 || a.table_mb == 0)
+        usage();
+    if (a.work == Work::kMemcpy && (a.bytes == 0 || a.bytes > a.table_mb * 1024 * 1024))
+        usage();
+    return a;
+}
+
+int64_t now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+uint64_t xorshift(uint64_t &s)
+{
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return s;
+}
+
+/**************************************************************************
+ * Requests
+ **************************************************************************/
+
+/* Open addressing, linear probing, half full; key 0 marks an empty slot */
+class HashTable {
+public:
+    explicit HashTable(size_t mb)
+    {
+        size_t n = 1;
+        while (n * 2 * sizeof(Slot) <= mb * 1024 * 1024)
+            n *= 2;
+        slots_.assign(n, Slot{0, 0});
+        mask_ = n - 1;
+        for (uint64_t k = 1; k <= n / 2; k++)
+            insert(k, k * 7);
+        keys_ = n / 2;
+    }
+
+    uint64_t lookup(uint64_t key) const
+    {
+        for (size_t i = hash(key) & mask_;; i = (i + 1) & mask_) {
+            if (slots_[i].key == key)
+                return slots_[i].value;
+            if (slots_[i].key == 0)
+                return 0;
+        }
+    }
+
+    uint64_t keys() const { return keys_; }
+
+private:
+    struct Slot {
+        uint64_t key;
+        uint64_t value;
+    };
+
+    static uint64_t hash(uint64_t k)
+    {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        return k;
+    }
+
+    void insert(uint64_t key, uint64_t value)
+    {
+        size_t i = hash(key) & mask_;
+        while (slots_[i].key)
+            i = (i + 1) & mask_;
+        slots_[i] = Slot{key, value};
+    }
+
+    std::vector<Slot> slots_;
+    size_t mask_ = 0;
+    uint64_t keys_ = 0;
+};
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+    Args a = parse(argc, argv);
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(a.cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err) {
+        std::fprintf(stderr, "areg-victim: cpu %d: %s\n", a.cpu, std::strerror(err));
+        return 1;
+    }
+
+    /* Build the working set after pinning so it is node-local */
+    HashTable *table = nullptr;
+    std::vector<uint8_t> arena, dst;
+    if (a.work == Work::kHash) {
+        table = new HashTable(a.table_mb);
+    } else {
+        arena.assign(a.table_mb * 1024 * 1024, 1);
+        dst.assign(a.bytes, 0);
+    }
+
+    areg::HdrHistogram latency, service;
+    uint64_t rnd = 0x9e3779b97f4a7c15ULL ^ a.cpu;
+    uint64_t sink = 0;
+    uint64_t n = static_cast<uint64_t>(a.duration_s * a.qps);
+    double period_ns = 1e9 / a.qps;
+    int64_t start = now_ns();
+
+    for (uint64_t i = 0; i < n; i++) {
+        int64_t due = start + static_cast<int64_t>(i * period_ns);
+        int64_t t = now_ns();
+        while (t < due)
+            t = now_ns();
+
+        if (table) {
+            for (unsigned k = 0; k < a.lookups; k++)
+                sink += table->lookup(xorshift(rnd) % table->keys() + 1);
+        } else {
+            size_t off = xorshift(rnd) % (arena.size() - a.bytes + 1);
+            std::memcpy(dst.data(), arena.data() + off, a.bytes);
+            sink += dst[xorshift(rnd) % a.bytes];
+        }
+
+        int64_t done = now_ns();
+        latency.record(done - due);
+        service.record(done - t);
+    }
+    int64_t elapsed = now_ns() - start;
+    delete table;
+
+    std::printf("# requests %llu in %.3f s (target %.0f/s, achieved %.0f/s) checksum %llu\n",
+                static_cast<unsigned long long>(n), elapsed * 1e-9, a.qps, n * 1e9 / elapsed,
+                static_cast<unsigned long long>(sink & 1));
+    std::printf("# what, mean_us, p50_us, p90_us, p99_us, p99.9_us, p99.99_us, max_us\n");
+    for (const auto &h : {std::make_pair("latency", &latency), std::make_pair("service", &service)})
+        std::printf("%s, %.2f, %.2f, %.2f, %.2f, %.2f, %.2f, %.2f\n", h.first,
+                    h.second->mean() * 1e-3, h.second->percentile(50) * 1e-3,
+                    h.second->percentile(90) * 1e-3, h.second->percentile(99) * 1e-3,
+                    h.second->percentile(99.9) * 1e-3, h.second->percentile(99.99) * 1e-3,
+                    h.second->max() * 1e-3);
+
+    if (!a.output.empty()) {
+        std::FILE *out = std::fopen(a.output.c_str(), "w");
+        if (!out) {
+            std::perror(a.output.c_str());
+            return 1;
+        }
+        latency.write_distribution(out);
+        std::fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,111 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * Userspace stand-ins for the kernel API used by the regulator's pure
+ * logic (model.c and the headers it needs), so the same sources can be
+ * compiled into the replay, tuning and simulation tools. Pulled in by
+ * kernel_headers.h when __KERNEL__ is not defined.
+ *
+ * Only what the shared code touches is provided; the embedded kernel
+ * objects of struct core_info (timers, irq_work, wait queues) are opaque.
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#ifndef AR_SHIM_H
+#define AR_SHIM_H
+
+#include <linux/types.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+/* Single-threaded users only */
+typedef struct { int counter; } atomic_t;
+typedef struct { long long counter; } atomic64_t;
+
+#define atomic_read(v)          ((v)->counter)
+#define atomic_set(v, i)        ((v)->counter = (i))
+#define atomic64_read(v)        ((v)->counter)
+#define atomic64_set(v, i)      ((v)->counter = (i))
+
+static inline int atomic_xchg(atomic_t *v, int i)
+{
+    int old = v->counter;
+
+    v->counter = i;
+    return old;
+}
+
+/* Locks of the kernel-only state of struct core_info; never contended here */
+typedef struct { int unused; } spinlock_t;
+
+#define spin_lock_init(l)                   do { (void)(l); } while (0)
+#define spin_lock(l)                        do { (void)(l); } while (0)
+#define spin_unlock(l)                      do { (void)(l); } while (0)
+#define spin_lock_irqsave(l, flags)         do { (void)(l); (flags) = 0; } while (0)
+#define spin_unlock_irqrestore(l, flags)    do { (void)(l); (void)(flags); } while (0)
+
+#define READ_ONCE(x)            (x)
+#define WRITE_ONCE(x, val)      ((x) = (val))
+
+#define BIT(nr)                 (1UL << (nr))
+#define max_t(type, x, y)       ((type)(x) > (type)(y) ? (type)(x) : (type)(y))
+#define min_t(type, x, y)       ((type)(x) < (type)(y) ? (type)(x) : (type)(y))
+#if !defined(__cplusplus)
+#define min(x, y)               ((x) < (y) ? (x) : (y))
+#define min3(x, y, z)           min(min(x, y), z)
+#endif
+
+/* Opaque kernel objects embedded in struct core_info */
+typedef struct { int unused; } wait_queue_head_t;
+struct hrtimer { int unused; };
+struct irq_work { int unused; };
+struct callback_head { struct callback_head *next; void (*func)(struct callback_head *); };
+struct task_struct;
+struct perf_event;
+struct dentry;
+
+#define DECLARE_EWMA(name, _precision, _weight_rcp) \
+    struct ewma_##name { unsigned long internal; };
+
+static inline void kernel_fpu_begin(void) { }
+static inline void kernel_fpu_end(void) { }
+
+static inline u64 mul_u64_u64_shr(u64 a, u64 b, unsigned int shift)
+{
+    return (u64)(((unsigned __int128)a * b) >> shift);
+}
+
+static inline u64 div_u64(u64 dividend, u32 divisor)
+{
+    return dividend / divisor;
+}
+
+static inline u64 div64_u64(u64 dividend, u64 divisor)
+{
+    return dividend / divisor;
+}
+
+#define pr_info(fmt, ...)       fprintf(stderr, pr_fmt(fmt), ##__VA_ARGS__)
+#define pr_warn(fmt, ...)       fprintf(stderr, pr_fmt(fmt), ##__VA_ARGS__)
+#define pr_err(fmt, ...)        fprintf(stderr, pr_fmt(fmt), ##__VA_ARGS__)
+#define pr_debug(fmt, ...)      do { } while (0)
+
+#define module_param(name, type, perm)
+#define module_param_named(name, value, type, perm)
+#define MODULE_PARM_DESC(name, desc)
+
+#endif /* AR_SHIM_H */
@@ -0,0 +1,75 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * Per-core demand series (MB/s per sample) from a recorded trace, for the
+ * replay and simulation tools. Accepts an areg-collect trace (.arc, the
+ * used_mb column) or a CSV whose rows are "t_ms, cpu, ..., mb" such as
+ * the output of areg-load -o.
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#ifndef AREG_DEMAND_H
+#define AREG_DEMAND_H
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "areg_trace.h"
+
+namespace areg {
+
+/* One series per core of @path, in core order; throws on a bad file */
+inline std::vector<std::vector<double>> load_demand(const std::string &path)
+{
+    std::map<uint32_t, std::vector<std::pair<int64_t, double>>> cores;
+    bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+
+    if (csv) {
+        std::ifstream in(path);
+        if (!in)
+            throw std::runtime_error(path + ": cannot open");
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#')
+                continue;
+            std::vector<std::string> f;
+            std::stringstream ss(line);
+            std::string tok;
+            while (std::getline(ss, tok, ','))
+                f.push_back(tok);
+            if (f.size() < 3)
+                throw std::runtime_error(path + ": expected t_ms, cpu, ..., mb");
+            cores[std::stoul(f[1])].push_back({std::stoll(f[0]), std::stod(f.back())});
+        }
+    } else {
+        TraceReader r(path);
+        r.scan(-1, INT64_MIN, INT64_MAX, [&](const Row &row) {
+            cores[row.cpu].push_back({row.v[kColTimestampNs],
+                                      static_cast<double>(row.v[kColUsedMb])});
+        });
+    }
+
+    std::vector<std::vector<double>> out;
+    for (auto &kv : cores) {
+        std::stable_sort(kv.second.begin(), kv.second.end(),
+                         [](const auto &x, const auto &y) { return x.first < y.first; });
+        std::vector<double> series;
+        for (const auto &s : kv.second)
+            series.push_back(s.second);
+        out.push_back(series);
+    }
+    return out;
+}
+
+} /* namespace areg */
+
+#endif /* AREG_DEMAND_H */
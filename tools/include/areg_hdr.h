@@ -0,0 +1,120 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * HDR-style latency histogram: log-linear buckets with a fixed relative
+ * error, so a microsecond and a second are both recorded to ~1% with a
+ * few thousand counters and no allocation on the record path.
+ *
+ * A value v < 2^kSubBits has its own bucket. Above that, every power of
+ * two is split into 2^(kSubBits-1) equal buckets, i.e. the width of a
+ * bucket is at most 1/2^(kSubBits-1) of its value.
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#ifndef AREG_HDR_H
+#define AREG_HDR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace areg {
+
+class HdrHistogram {
+public:
+    static constexpr unsigned kSubBits = 8; /* <= 0.8% relative error */
+    static constexpr uint64_t kSubCount = 1ULL << kSubBits;
+    static constexpr uint64_t kHalf = kSubCount / 2;
+    static constexpr size_t kBuckets = kSubCount + (64 - kSubBits) * kHalf;
+
+    HdrHistogram() : counts_(kBuckets, 0) {}
+
+    void record(uint64_t v, uint64_t n = 1)
+    {
+        counts_[index(v)] += n;
+        total_ += n;
+        sum_ += static_cast<double>(v) * n;
+        min_ = std::min(min_, v);
+        max_ = std::max(max_, v);
+    }
+
+    void merge(const HdrHistogram &o)
+    {
+        for (size_t i = 0; i < kBuckets; i++)
+            counts_[i] += o.counts_[i];
+        total_ += o.total_;
+        sum_ += o.sum_;
+        min_ = std::min(min_, o.min_);
+        max_ = std::max(max_, o.max_);
+    }
+
+    void reset() { *this = HdrHistogram(); }
+
+    uint64_t count() const { return total_; }
+    uint64_t min() const { return total_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return total_ ? sum_ / total_ : 0; }
+
+    /* Highest value equivalent to the p-th percentile (0 < p <= 100) */
+    uint64_t percentile(double p) const
+    {
+        if (!total_)
+            return 0;
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * total_ + 0.5);
+        rank = std::max<uint64_t>(rank, 1);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; i++) {
+            seen += counts_[i];
+            if (seen >= rank)
+                return std::min(highest(i), max_);
+        }
+        return max_;
+    }
+
+    /* "value, percentile, count" rows for every non-empty bucket */
+    void write_distribution(std::FILE *out) const
+    {
+        uint64_t seen = 0;
+        std::fprintf(out, "# value, percentile, total_count\n");
+        for (size_t i = 0; i < kBuckets; i++) {
+            if (!counts_[i])
+                continue;
+            seen += counts_[i];
+            std::fprintf(out, "%llu, %.6f, %llu\n",
+                         static_cast<unsigned long long>(std::min(highest(i), max_)),
+                         100.0 * seen / total_, static_cast<unsigned long long>(seen));
+        }
+    }
+
+    static size_t index(uint64_t v)
+    {
+        if (v < kSubCount)
+            return v;
+        unsigned shift = 63 - __builtin_clzll(v) - (kSubBits - 1);
+        return kSubCount + (shift - 1) * kHalf + ((v >> shift) - kHalf);
+    }
+
+    /* Largest value recorded into bucket i */
+    static uint64_t highest(size_t i)
+    {
+        if (i < kSubCount)
+            return i;
+        unsigned shift = (i - kSubCount) / kHalf + 1;
+        uint64_t m = (i - kSubCount) % kHalf + kHalf;
+        return ((m + 1) << shift) - 1;
+    }
+
+private:
+    std::vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+    double sum_ = 0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+};
+
+} /* namespace areg */
+
+#endif /* AREG_HDR_H */
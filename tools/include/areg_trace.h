@@ -0,0 +1,354 @@
+/**
+ * Dynamic adaptive memory bandwidth controller for multi-core systems
+ *
+ * Compact columnar trace format for per-interval regulator samples.
+ *
+ * File layout:
+ *   FileHeader
+ *   Block *        one core, up to kBlockRows rows, columns back to back
+ *   IndexEntry *   one per block: cpu, time range, file offset
+ *   Footer         offset/count of the index, magic
+ *
+ * Each column is transformed (delta, or delta-of-delta for the timestamp)
+ * and written as zigzag varints with zero runs collapsed into one token:
+ *   token = zigzag(v) << 1        for a non-zero value v
+ *   token = (run << 1) | 1        for run consecutive zeros
+ * Slowly changing columns (budget, cumulative counters, flags) therefore
+ * cost close to nothing, and readers can skip whole blocks by time/core.
+ *
+ * This file is distributed under GPL v2 License.
+ * See LICENSE.TXT for details.
+ *
+ */
+#ifndef AREG_TRACE_H
+#define AREG_TRACE_H
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace areg {
+
+/* Columns of a trace row, in file order */
+enum Column : unsigned {
+    kColTimestampNs = 0,
+    kColUsedMb,
+    kColPredictedMb,
+    kColBudgetMb,
+    kColOverflows,
+    kColThrottledNs,
+    kColFlags,
+    kNumColumns
+};
+
+static const char *const kColumnNames[kNumColumns] = {
+    "timestamp_ns", "used_mb", "predicted_mb", "budget_mb",
+    "overflows", "throttled_ns", "flags",
+};
+
+struct Row {
+    uint32_t cpu = 0;
+    std::array<int64_t, kNumColumns> v{};
+};
+
+constexpr uint32_t kTraceVersion = 1;
+constexpr uint32_t kBlockRows = 4096;
+static const char kHeaderMagic[8] = {'A', 'R', 'E', 'G', 'T', 'R', 'C', '1'};
+static const char kFooterMagic[8] = {'A', 'R', 'E', 'G', 'I', 'D', 'X', '1'};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_columns;
+};
+
+struct BlockHeader {
+    uint32_t cpu;
+    uint32_t rows;
+    int64_t t_first;
+    int64_t t_last;
+    uint32_t col_bytes[kNumColumns];
+};
+
+struct IndexEntry {
+    uint32_t cpu;
+    uint32_t rows;
+    int64_t t_first;
+    int64_t t_last;
+    uint64_t offset;
+};
+
+struct Footer {
+    uint64_t index_offset;
+    uint64_t num_entries;
+    char magic[8];
+};
+
+/**************************************************************************
+ * Column codec
+ **************************************************************************/
+
+inline uint64_t zigzag(int64_t v) { return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63); }
+inline int64_t unzigzag(uint64_t v) { return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1); }
+
+inline void put_varint(std::vector<uint8_t> &out, uint64_t v)
+{
+    while (v >= 0x80) {
+        out.push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+inline uint64_t get_varint(const uint8_t *&p, const uint8_t *end)
+{
+    uint64_t v = 0;
+    for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        v |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return v;
+    }
+    throw std::runtime_error("truncated varint");
+}
+
+/* Encode already transformed values (deltas) of one column */
+inline void encode_column(std::vector<uint8_t> &out, const std::vector<int64_t> &vals)
+{
+    uint64_t run = 0;
+    for (int64_t v : vals) {
+        if (v == 0) {
+            run++;
+            continue;
+        }
+        if (run) {
+            put_varint(out, (run << 1) | 1);
+            run = 0;
+        }
+        put_varint(out, zigzag(v) << 1);
+    }
+    if (run)
+        put_varint(out, (run << 1) | 1);
+}
+
+inline void decode_column(const uint8_t *p, const uint8_t *end, size_t rows, std::vector<int64_t> &vals)
+{
+    vals.clear();
+    vals.reserve(rows);
+    while (vals.size() < rows) {
+        uint64_t tok = get_varint(p, end);
+        if (tok & 1)
+            vals.insert(vals.end(), tok >> 1, 0);
+        else
+            vals.push_back(unzigzag(tok >> 1));
+    }
+    if (vals.size() != rows)
+        throw std::runtime_error("column length mismatch");
+}
+
+/**************************************************************************
+ * Writer
+ **************************************************************************/
+
+class TraceWriter {
+public:
+    explicit TraceWriter(const std::string &path)
+    {
+        f_ = std::fopen(path.c_str(), "wb");
+        if (!f_)
+            throw std::runtime_error("cannot open " + path);
+        FileHeader h{};
+        std::memcpy(h.magic, kHeaderMagic, sizeof(h.magic));
+        h.version = kTraceVersion;
+        h.num_columns = kNumColumns;
+        write(&h, sizeof(h));
+    }
+
+    ~TraceWriter()
+    {
+        if (f_)
+            close();
+    }
+
+    void append(const Row &r)
+    {
+        auto &rows = pending_[r.cpu];
+        rows.push_back(r);
+        if (rows.size() >= kBlockRows) {
+            flush_block(r.cpu, rows);
+            rows.clear();
+        }
+    }
+
+    void close()
+    {
+        for (auto &kv : pending_)
+            if (!kv.second.empty())
+                flush_block(kv.first, kv.second);
+        pending_.clear();
+
+        Footer ft{};
+        ft.index_offset = offset_;
+        ft.num_entries = index_.size();
+        std::memcpy(ft.magic, kFooterMagic, sizeof(ft.magic));
+        if (!index_.empty())
+            write(index_.data(), index_.size() * sizeof(IndexEntry));
+        write(&ft, sizeof(ft));
+        std::fclose(f_);
+        f_ = nullptr;
+    }
+
+    uint64_t bytes_written() const { return offset_; }
+
+private:
+    void write(const void *p, size_t n)
+    {
+        if (std::fwrite(p, 1, n, f_) != n)
+            throw std::runtime_error("short write");
+        offset_ += n;
+    }
+
+    void flush_block(uint32_t cpu, const std::vector<Row> &rows)
+    {
+        BlockHeader bh{};
+        std::vector<uint8_t> cols[kNumColumns];
+        std::vector<int64_t> vals(rows.size());
+
+        bh.cpu = cpu;
+        bh.rows = static_cast<uint32_t>(rows.size());
+        bh.t_first = rows.front().v[kColTimestampNs];
+        bh.t_last = rows.back().v[kColTimestampNs];
+
+        for (unsigned c = 0; c < kNumColumns; c++) {
+            int64_t prev = 0, prev_delta = 0;
+            for (size_t i = 0; i < rows.size(); i++) {
+                int64_t delta = rows[i].v[c] - prev;
+                prev = rows[i].v[c];
+                if (c == kColTimestampNs) {
+                    vals[i] = delta - prev_delta;
+                    prev_delta = delta;
+                } else {
+                    vals[i] = delta;
+                }
+            }
+            encode_column(cols[c], vals);
+            bh.col_bytes[c] = static_cast<uint32_t>(cols[c].size());
+        }
+
+        index_.push_back({cpu, bh.rows, bh.t_first, bh.t_last, offset_});
+        write(&bh, sizeof(bh));
+        for (unsigned c = 0; c < kNumColumns; c++)
+            write(cols[c].data(), cols[c].size());
+    }
+
+    std::FILE *f_ = nullptr;
+    uint64_t offset_ = 0;
+    std::map<uint32_t, std::vector<Row>> pending_;
+    std::vector<IndexEntry> index_;
+};
+
+/**************************************************************************
+ * Reader
+ **************************************************************************/
+
+class TraceReader {
+public:
+    explicit TraceReader(const std::string &path)
+    {
+        f_ = std::fopen(path.c_str(), "rb");
+        if (!f_)
+            throw std::runtime_error("cannot open " + path);
+
+        FileHeader h{};
+        read_at(0, &h, sizeof(h));
+        if (std::memcmp(h.magic, kHeaderMagic, sizeof(h.magic)) || h.version != kTraceVersion ||
+            h.num_columns != kNumColumns)
+            throw std::runtime_error(path + ": not an areg trace");
+
+        Footer ft{};
+        std::fseek(f_, -static_cast<long>(sizeof(ft)), SEEK_END);
+        if (std::fread(&ft, sizeof(ft), 1, f_) != 1 ||
+            std::memcmp(ft.magic, kFooterMagic, sizeof(ft.magic)))
+            throw std::runtime_error(path + ": missing index (collector not closed cleanly?)");
+
+        index_.resize(ft.num_entries);
+        if (ft.num_entries)
+            read_at(ft.index_offset, index_.data(), index_.size() * sizeof(IndexEntry));
+    }
+
+    ~TraceReader()
+    {
+        if (f_)
+            std::fclose(f_);
+    }
+
+    const std::vector<IndexEntry> &index() const { return index_; }
+
+    /*
+     * Visit rows of @cpu (or all cores when cpu < 0) with a timestamp in
+     * [t_from, t_to], block by block in file order.
+     */
+    void scan(int cpu, int64_t t_from, int64_t t_to, const std::function<void(const Row &)> &fn)
+    {
+        std::vector<uint8_t> buf;
+        std::vector<int64_t> cols[kNumColumns];
+
+        for (const IndexEntry &e : index_) {
+            if ((cpu >= 0 && e.cpu != static_cast<uint32_t>(cpu)) || e.t_last < t_from || e.t_first > t_to)
+                continue;
+
+            BlockHeader bh{};
+            read_at(e.offset, &bh, sizeof(bh));
+            size_t total = 0;
+            for (unsigned c = 0; c < kNumColumns; c++)
+                total += bh.col_bytes[c];
+            buf.resize(total);
+            if (total)
+                read_at(e.offset + sizeof(bh), buf.data(), total);
+
+            const uint8_t *p = buf.data();
+            for (unsigned c = 0; c < kNumColumns; c++) {
+                decode_column(p, p + bh.col_bytes[c], bh.rows, cols[c]);
+                p += bh.col_bytes[c];
+            }
+
+            Row r;
+            r.cpu = bh.cpu;
+            int64_t prev[kNumColumns] = {0};
+            int64_t ts_delta = 0;
+            for (uint32_t i = 0; i < bh.rows; i++) {
+                for (unsigned c = 0; c < kNumColumns; c++) {
+                    if (c == kColTimestampNs) {
+                        ts_delta += cols[c][i];
+                        prev[c] += ts_delta;
+                    } else {
+                        prev[c] += cols[c][i];
+                    }
+                    r.v[c] = prev[c];
+                }
+                if (r.v[kColTimestampNs] >= t_from && r.v[kColTimestampNs] <= t_to)
+                    fn(r);
+            }
+        }
+    }
+
+private:
+    void read_at(uint64_t off, void *p, size_t n)
+    {
+        if (std::fseek(f_, static_cast<long>(off), SEEK_SET) || std::fread(p, 1, n, f_) != n)
+            throw std::runtime_error("short read");
+    }
+
+    std::FILE *f_ = nullptr;
+    std::vector<IndexEntry> index_;
+};
+
+} /* namespace areg */
+
+#endif /* AREG_TRACE_H */